@@ -0,0 +1,83 @@
+#include "auction.hpp"
+
+#include <algorithm>
+
+namespace eosio {
+
+    auction_t run_auction(const pair_t& pair, vector<auction_order>& bids, vector<auction_order>& asks) {
+        auto priority = [](const auction_order& a, const auction_order& b) {
+            if (a.price != b.price) return a.side == ask ? a.price < b.price : a.price > b.price;
+            if (a.resting != b.resting) return a.resting;
+            return a.id < b.id;
+        };
+        std::sort(bids.begin(), bids.end(), priority);
+        std::sort(asks.begin(), asks.end(), priority);
+
+        // the traded base only steps at a limit price, so those are the
+        // only candidates; bids spend their quote, so the base they buy
+        // grows as the price falls
+        vector<uint64_t> candidates;
+        for (const auto& order : bids) candidates.push_back(order.price);
+        for (const auto& order : asks) candidates.push_back(order.price);
+        std::sort(candidates.begin(), candidates.end());
+        candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+
+        // bids take from the asks in priority order; the quote is rounded
+        // in favour of a resting order, and down between two queued ones.
+        // Two resting orders or two of one owner are stepped over, so the
+        // base that trades at a price is what this matches, which can be
+        // less than the crossing demand and supply
+        auto match = [&](uint64_t price, vector<auction_fill>* fills) {
+            int64_t traded = 0;
+            vector<int64_t> asks_left;
+            for (const auto& order : asks) asks_left.push_back(order.amount);
+            for (size_t b = 0; b < bids.size() && bids[b].price >= price; b++) {
+                int64_t quote_left = bids[b].amount;
+                for (size_t a = 0; a < asks.size() && asks[a].price <= price; a++) {
+                    if (asks_left[a] == 0) continue;
+                    if ((bids[b].resting && asks[a].resting) || bids[b].owner == asks[a].owner) continue;
+
+                    int64_t base = std::min(asks_left[a], quote_to_base(pair, price, quote_left, false));
+                    if (base == 0) break;
+                    int64_t quote = base_to_quote(pair, price, base, asks[a].resting);
+
+                    if (fills) fills->push_back(auction_fill{b, a, base, quote});
+                    traded += base;
+                    asks_left[a] -= base;
+                    quote_left -= quote;
+                }
+            }
+            return traded;
+        };
+
+        auction_t result{0, {}};
+        int64_t best_volume = 0;
+        int64_t best_imbalance = 0;
+        for (auto price : candidates) {
+            int64_t demand = 0;
+            for (const auto& order : bids) {
+                if (order.price < price) break;
+                demand += quote_to_base(pair, price, order.amount, false);
+            }
+            int64_t supply = 0;
+            for (const auto& order : asks) {
+                if (order.price > price) break;
+                supply += order.amount;
+            }
+            // what crosses bounds what matches, so most prices need no match
+            if (std::min(demand, supply) < best_volume) continue;
+
+            int64_t volume = match(price, nullptr);
+            int64_t imbalance = demand + supply - 2 * volume;
+            if (volume > best_volume || (volume == best_volume && volume > 0 && imbalance < best_imbalance)) {
+                result.price = price;
+                best_volume = volume;
+                best_imbalance = imbalance;
+            }
+        }
+        if (result.price == 0) return result;
+
+        match(result.price, &result.fills);
+        return result;
+    }
+} // namespace eosio
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <eosiolib/eosio.hpp>
+#include "exchange_state.hpp"
+
+namespace eosio {
+
+    // One order taking part in a batch auction, either queued in `pending`
+    // or resting in the book. It holds base if it is an ask and quote if it
+    // is a bid, and trades at its price or better.
+    struct auction_order {
+        uint64_t id;
+        account_name owner;
+        bool resting;
+        uint8_t side;
+        int64_t amount;
+        uint64_t price;
+    };
+
+    // bids[bid] buys `base` from asks[ask] for `quote`
+    struct auction_fill {
+        size_t bid;
+        size_t ask;
+        int64_t base;
+        int64_t quote;
+    };
+
+    struct auction_t {
+        // the uniform price every fill trades at, 0 when nothing crosses
+        uint64_t price;
+        vector<auction_fill> fills;
+    };
+
+    // Clears bids against asks at the single price that trades the most
+    // base, then leaves the least unmatched at that price, then is lowest.
+    // Both lists are sorted into priority order first: best price, resting
+    // orders before queued ones, then the oldest. Two resting orders never
+    // trade with each other, nor do two orders of one owner, so the base a
+    // price trades counts only what the other orders match at it.
+    auction_t run_auction(const pair_t& pair, vector<auction_order>& bids, vector<auction_order>& asks);
+} // namespace eosio
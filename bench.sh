@@ -0,0 +1,64 @@
+#!/usr/bin/env bash
+set -e
+
+BUILD_DIR=native/build
+NATIVE_DIR=native
+CPP_FILENAME=exchange.cpp
+BENCH_FILENAME=bench
+CXX=${CXX:-g++}
+
+ARGUMENT_LIST=(
+	"MAX_DEPTH"
+	"ITERATIONS"
+)
+
+opts=$(getopt \
+	--longoptions "$(printf "%s:," "${ARGUMENT_LIST[@]}")TRACE" \
+	--name "$(basename "$0")" \
+	--options "" \
+	-- "$@"
+)
+
+function usage() {
+	echo "Usage: ./bench.sh [ARGS]"
+	echo "--MAX_DEPTH - largest number of resting orders per pair (default 100000)"
+	echo "--ITERATIONS - timed runs of each action per depth (default 20)"
+	echo "--TRACE - build with EXCHANGE_TRACE and report the contract's own counters"
+	echo "Example:"
+	echo "./bench.sh --MAX_DEPTH 10000 --ITERATIONS 50"
+}
+
+function compile() {
+	mkdir -p ${BUILD_DIR}
+	${CXX} -std=c++17 -O2 ${DEFINES} -I${NATIVE_DIR} -o ${BUILD_DIR}/${BENCH_FILENAME} ${NATIVE_DIR}/bench.cpp ${NATIVE_DIR}/mirror.cpp ${CPP_FILENAME}
+}
+
+MAX_DEPTH=100000
+ITERATIONS=20
+DEFINES=
+
+eval set --$opts
+while [[ $# -gt 0 ]]; do
+	case "$1" in
+		--MAX_DEPTH)
+			MAX_DEPTH=$2
+			shift 2
+			;;
+
+		--ITERATIONS)
+			ITERATIONS=$2
+			shift 2
+			;;
+
+		--TRACE)
+			DEFINES=-DEXCHANGE_TRACE
+			shift
+			;;
+		*)
+			break
+			;;
+	esac
+done
+
+compile
+${BUILD_DIR}/${BENCH_FILENAME} ${MAX_DEPTH} ${ITERATIONS}
@@ -0,0 +1,45 @@
+#include "events.hpp"
+
+namespace eosio {
+
+    void book_events::fill(uint64_t pair_id, uint64_t id, account_name owner, uint8_t side, uint64_t price,
+                           int64_t amount, int64_t paid) {
+        _events.push_back(book_event{order_filled, pair_id, id, owner, side, price, amount, paid});
+    }
+
+    void book_events::reserve_fill(uint64_t pair_id, uint8_t side, uint64_t price, int64_t amount, int64_t paid) {
+        _events.push_back(book_event{reserve_filled, pair_id, pair_id, 0, side, price, amount, paid});
+    }
+
+    void book_events::queued_fill(uint64_t pair_id, uint64_t id, account_name owner, uint8_t side, uint64_t price,
+                                  int64_t amount, int64_t paid) {
+        _events.push_back(book_event{queued_filled, pair_id, id, owner, side, price, amount, paid});
+    }
+
+    void book_events::rest(uint64_t pair_id, const exchange_state& order, int64_t amount) {
+        _events.push_back(book_event{order_rested, pair_id, order.id, order.manager, order.side, order.price, amount, 0});
+    }
+
+    void book_events::release(uint64_t pair_id, const exchange_state& order) {
+        _events.push_back(book_event{order_released, pair_id, order.id, order.manager, order.side, order.price, order.total(), 0});
+    }
+
+    void book_events::flush() {
+        if (_events.empty()) return;
+
+        // one counter row for every pair, so the numbers order the batches too
+        event_sequence_singleton sequence(_self, _self);
+        auto next = sequence.get_or_default(event_sequence_t{0});
+        event_batch batch{next.next, std::move(_events)};
+        next.next += batch.events.size();
+        TRACE_COUNT(rows_written, 1);
+        sequence.set(next, _self);
+
+        action(permission_level(_self, N(active)),
+               _self,
+               N(eventlog),
+               batch).send();
+        TRACE_COUNT(inline_actions, 1);
+        _events.clear();
+    }
+} // namespace eosio
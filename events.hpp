@@ -0,0 +1,74 @@
+#pragma once
+
+#include <eosiolib/eosio.hpp>
+#include "exchange_state.hpp"
+
+namespace eosio {
+
+    enum book_event_kind : uint8_t {
+        // a book order paid out amount for paid
+        order_filled = 0,
+        // the pair's reserve paid out amount for paid; order_id is the pair's id
+        reserve_filled = 1,
+        // a queued batch order paid out amount for paid in its pair's auction;
+        // order_id is its `pending` id
+        queued_filled = 2,
+        // an order rested amount more at price, as a new row or on an existing one
+        order_rested = 3,
+        // an order left the book unfilled and amount went back to its owner
+        order_released = 4
+    };
+
+    // one change of a book. A fill's price is the one it traded at; other
+    // events carry the order's, which for a ladder is its best level's
+    struct book_event {
+        uint8_t kind;
+        uint64_t pair_id;
+        uint64_t order_id;
+        account_name owner;
+        uint8_t side;
+        uint64_t price;
+        int64_t amount;
+        // what the order received, fills only
+        int64_t paid;
+
+        EOSLIB_SERIALIZE(book_event, (kind)(pair_id)(order_id)(owner)(side)(price)(amount)(paid))
+    };
+
+    // the data of the `eventlog` action: an action's events in the order
+    // they happened, the n-th of them numbered sequence + n. Numbers run on
+    // across actions without gaps, so a consumer that sees one skipped
+    // missed a batch
+    struct event_batch {
+        uint64_t sequence;
+        vector<book_event> events;
+
+        EOSLIB_SERIALIZE(event_batch, (sequence)(events))
+    };
+
+    // Collects the book events of one action and sends them to the contract
+    // itself as one `eventlog` inline action after dispatch, so indexers can
+    // follow the books from action traces instead of polling `markets`.
+    class book_events {
+    public:
+        book_events(account_name self) : _self(self) {}
+
+        void fill(uint64_t pair_id, uint64_t id, account_name owner, uint8_t side, uint64_t price,
+                  int64_t amount, int64_t paid);
+
+        void reserve_fill(uint64_t pair_id, uint8_t side, uint64_t price, int64_t amount, int64_t paid);
+
+        void queued_fill(uint64_t pair_id, uint64_t id, account_name owner, uint8_t side, uint64_t price,
+                         int64_t amount, int64_t paid);
+
+        void rest(uint64_t pair_id, const exchange_state& order, int64_t amount);
+
+        void release(uint64_t pair_id, const exchange_state& order);
+
+        void flush();
+
+    private:
+        account_name _self;
+        vector<book_event> _events;
+    };
+} // namespace eosio
@@ -1,8 +1,15 @@
 #include "exchange.hpp"
 #include "exchange_state.cpp"
 #include "whitelisted.cpp"
+#include "settlement.cpp"
+#include "ticker.cpp"
+#include "matching.cpp"
+#include "auction.cpp"
+#include "events.cpp"
 
+#include <eosiolib/db.h>
 #include <eosiolib/dispatcher.hpp>
+#include <eosiolib/transaction.hpp>
 #include <string>
 
 namespace eosio {
@@ -17,392 +24,1240 @@ namespace eosio {
         eosio_assert(t.sell_symbol.is_valid(), "invalid sell amount");
         eosio_assert(t.receive.is_valid(), "invalid receive amount");
 
-        auto base_symbol = t.receive.symbol;
-        auto quote_symbol = t.sell_symbol;
-        eosio_assert(base_symbol != quote_symbol, "invalid exchange");
+        eosio_assert(t.receive.symbol != t.sell_symbol, "invalid exchange");
 
-        auto pairs = pairs_table(_self, _self);
-        auto existing_pair = pairs.end();
-        for (auto itr = pairs.begin(); itr != pairs.end(); itr++) {
-            if (itr->base_symbol == base_symbol && itr->quote_symbol == quote_symbol) {
-                existing_pair = itr;
-                break;
-            }
+        const auto& existing_pair = get_pair(t.receive.symbol, t.sell_symbol);
+
+        markets_table markets(_self, existing_pair.id);
+        auto existing = markets.find(t.id);
+        eosio_assert(existing != markets.end(), "Order with the specified primary key doesn't exist");
+        eosio_assert(existing->get_symbol(existing_pair) == t.receive.symbol, "Order sells another token");
+        eosio_assert(existing->amount == t.receive.amount, "Base deposits must be the same");
+        eosio_assert(!existing->is_expired(now()), "order expired");
+
+        auto sell = extended_asset(existing->pays_for(existing_pair, existing->amount), _extended(t.sell_symbol));
+        auto receive = extended_asset(t.receive, _extended(t.receive.symbol).contract);
+        settle.fill(t.seller, existing->manager, sell, receive);
+        events.fill(existing_pair.id, existing->id, existing->manager, existing->side, existing->price,
+                    t.receive.amount, sell.amount);
+        if (existing->side == ask) {
+            ticks.fill(existing_pair.id, ask, existing->price, receive.amount, sell.amount);
+        } else {
+            ticks.fill(existing_pair.id, bid, existing->price, sell.amount, receive.amount);
         }
-        eosio_assert(existing_pair != pairs.end(), "Pair doesn't exist");
 
-        extended_symbol sell_symbol;
-        extended_asset receive;
-        if (t.sell_symbol == wu_symbol) {
-            sell_symbol = extended_symbol(t.sell_symbol, wu_contract);
-            receive = extended_asset(t.receive, loyalty_contract);
+        auto rest = *existing;
+        if (rest.take(t.receive.amount)) {
+            TRACE_COUNT(rows_written, 1);
+            markets.modify(existing, _self, [&](auto &s) {
+                s = rest;
+            });
         } else {
-            sell_symbol = extended_symbol(t.sell_symbol, loyalty_contract);
-            receive = extended_asset(t.receive, wu_contract);
+            TRACE_COUNT(rows_erased, 1);
+            _erase_order(markets, *existing);
         }
+    }
 
-        markets_table markets(_self, existing_pair->id);
-        auto existing = markets.find(t.id);
-        eosio_assert(existing != markets.end(), "Order with the specified primary key doesn't exist");
-        eosio_assert(existing->base == receive, "Base deposits must be the same");
-        eosio_assert(existing->quote_symbol == sell_symbol, "Base symbols must be the same");
+    void exchange::on(const market_trade &t) {
+        // market order: get X receive for any sell, from whichever side holds it
+        require_auth(t.seller);
+        eosio_assert(is_whitelisted(t.seller), "Account is not whitelisted");
+        eosio_assert(t.receive.is_valid(), "invalid receive amount");
+        eosio_assert(t.receive.symbol != t.sell_symbol, "invalid exchange");
+        eosio_assert(t.receive.amount > 0, "receive amount must be positive");
+        eosio_assert(t.tif == fill_or_kill || t.tif == immediate_or_cancel, "market orders can't rest");
+
+        auto result = _buy(t.seller, get_pair(t.receive.symbol, t.sell_symbol), t.receive, t.max_fills);
+        eosio_assert(result.received == t.receive || t.tif == immediate_or_cancel, "unable to fill");
+    }
 
-        extended_asset sell = existing->convert(receive, sell_symbol);
+    void exchange::on(const limit_trade &t) {
+        // limit order: get maximum receive for X sell
+        require_auth(t.seller);
+        eosio_assert(is_whitelisted(t.seller), "Account is not whitelisted");
+        eosio_assert(t.sell.is_valid(), "invalid sell amount");
+        eosio_assert(t.receive_symbol != t.sell.symbol, "invalid exchange");
+        eosio_assert(t.sell.amount > 0, ("sell amount must be positive" + std::to_string(t.sell.amount)).c_str());
+        eosio_assert(t.tif <= batch, "invalid time in force");
+        eosio_assert(t.tif < good_till_cancel || t.price > 0, "good-till-cancel orders need a limit price");
+
+        const auto& existing_pair = get_pair(t.receive_symbol, t.sell.symbol);
+        if (t.tif == batch) {
+            settle.allow(t.seller, extended_asset(t.sell, _extended(t.sell.symbol).contract));
+            pending_table pending(_self, existing_pair.id);
+            TRACE_COUNT(rows_written, 1);
+            pending.emplace(t.seller, [&](auto &o) {
+                o.id = pending.available_primary_key();
+                o.owner = t.seller;
+                o.side = t.sell.symbol == existing_pair.base_symbol ? ask : bid;
+                o.amount = t.sell.amount;
+                o.price = t.price;
+            });
+            return;
+        }
 
-        markets.erase(existing);
+        auto result = _sell(t.seller, existing_pair, t.sell, t.price, t.max_fills, false);
+        if (result.sold == t.sell) return;
 
-        _allowclaim(t.seller, sell);
-        _claim(t.seller, existing->manager, sell);
-        _claim(existing->manager, t.seller, receive);
+        eosio_assert(t.tif != fill_or_kill, "unable to fill");
+        if (t.tif == good_till_cancel) {
+            // resting while orders within the limit are left would cross the book
+            eosio_assert(!result.bounded, "max_fills reached before the limit price");
+            _rest(t.seller, existing_pair, t.sell - result.sold, t.price, 0, false);
+        }
     }
 
-    void exchange::on(const market_trade &t) {
-        // market order: get X receive (base) for any sell (quote)
-        auto base_symbol = t.receive.symbol;
-        auto quote_symbol = t.sell_symbol;
-
+    void exchange::on(const trade &t) {
+        // LT -> WU -> LT: the WU the first leg actually yields is what the second leg sells
         require_auth(t.seller);
         eosio_assert(is_whitelisted(t.seller), "Account is not whitelisted");
-        eosio_assert(t.receive.is_valid(), "invalid receive amount");
-        eosio_assert(base_symbol != quote_symbol, "invalid exchange");
+        eosio_assert(t.sell.is_valid(), "invalid sell amount");
+        eosio_assert(t.sell.amount > 0, "sell amount must be positive");
+        eosio_assert(t.min_receive.is_valid(), "invalid minimum receive amount");
+        eosio_assert(t.min_receive.amount >= 0, "minimum receive amount must not be negative");
+        eosio_assert(!tokens::is_quote(t.sell.symbol) && !tokens::is_quote(t.min_receive.symbol),
+                     "trade routes between loyalty tokens");
+
+        const auto& first_pair = get_pair(wu_token::symbol, t.sell.symbol);
+        const auto& second_pair = get_pair(t.min_receive.symbol, wu_token::symbol);
+
+        auto first = _sell(t.seller, first_pair, t.sell, 0, 0, false);
+        eosio_assert(first.sold == t.sell, "unable to fill");
+        auto second = _sell(t.seller, second_pair, first.received, 0, 0, false);
+        eosio_assert(second.sold == first.received, "unable to fill");
+        eosio_assert(second.received >= t.min_receive, "received less than the minimum");
+    }
 
-        auto pairs = pairs_table(_self, _self);
-        auto existing_pair = pairs.end();
-        for (auto pair = pairs.begin(); pair != pairs.end(); pair++) {
-            if (pair->base_symbol == base_symbol && pair->quote_symbol == quote_symbol) {
-                existing_pair = pair;
-                break;
-            }
-        }
-        eosio_assert(existing_pair != pairs.end(), "Pair doesn't exist");
+    quote_t exchange::_buy(account_name seller, const pair_t& pair, const asset& receive, uint16_t max_fills) {
+        markets_table markets(_self, pair.id);
+        auto quote = quote_buy(markets, _reserve(pair), pair, seller, receive, max_fills, now());
+        _execute(seller, pair, markets, quote, false);
+        return quote;
+    }
 
-        account_name base_contract = base_symbol == wu_symbol ? wu_contract : loyalty_contract;
-        account_name quote_contract = quote_symbol == wu_symbol ? wu_contract : loyalty_contract;
+    quote_t exchange::_sell(account_name seller, const pair_t& pair, const asset& sell, uint64_t limit_price, uint16_t max_fills,
+                            bool escrowed) {
+        markets_table markets(_self, pair.id);
+        auto quote = quote_sell(markets, _reserve(pair), pair, seller, sell, limit_price, max_fills, now());
+        _execute(seller, pair, markets, quote, escrowed);
+        return quote;
+    }
 
-        markets_table markets(_self, existing_pair->id);
-        eosio_assert(t.receive.amount > 0, "receive amount must be positive");
-        auto sold = asset(0, quote_symbol);
-        auto received = asset(0, base_symbol);
+    void exchange::_execute(account_name seller, const pair_t& pair, markets_table& markets, const quote_t& quote, bool escrowed) {
+        auto order_symbol = _extended(quote.received.symbol);
+        auto taker_symbol = _extended(quote.sold.symbol);
 
-        auto sorted_markets = markets.get_index<N(byprice)>();
-        for (auto order = sorted_markets.begin(); order != sorted_markets.end(); ) {
-            if (order->manager == t.seller || order->quote_symbol != quote_symbol || order->base.symbol != base_symbol) {
-                order++;
+        // an expired order never fills; it is refunded and erased while the
+        // action's purge budget lasts and stepped over after that
+        for (auto id : quote.expired) {
+            if (_purge_budget == 0) break;
+            _purge_budget--;
+
+            const auto& order = markets.get(id);
+            _release(pair, order);
+            TRACE_COUNT(rows_erased, 1);
+            _erase_order(markets, order);
+        }
+
+        // the reserve's fills add up to one write of its row
+        reserve_t pool{};
+        bool from_reserve = false;
+        for (const auto& fill : quote.fills) {
+            if (fill.from_reserve) {
+                // the taker trades with what the contract holds itself
+                if (!from_reserve) pool = reserves.get(pair.id);
+                from_reserve = true;
+                pool = pool.traded(quote.side, fill.out, fill.in);
+                if (escrowed) {
+                    settle.debit(seller, extended_asset(fill.in, taker_symbol));
+                } else {
+                    settle.charge(seller, extended_asset(fill.in, taker_symbol));
+                }
+                settle.credit(seller, extended_asset(fill.out, order_symbol));
+                if (quote.side == ask) {
+                    ticks.trade(pair.id, fill.price, fill.out, fill.in);
+                } else {
+                    ticks.trade(pair.id, fill.price, fill.in, fill.out);
+                }
+                events.reserve_fill(pair.id, quote.side, fill.price, fill.out, fill.in);
                 continue;
             }
-            extended_asset estimated_to_receive = extended_asset(t.receive - received, base_contract);
-            auto min = min_asset(extended_asset(order->base, base_contract), estimated_to_receive);
-            received += min;
-            extended_asset output = order->convert(min, extended_symbol(order->quote_symbol, quote_contract));
-            sold += output;
-
-            _allowclaim(t.seller, output);
-            _claim(t.seller, order->manager, output);
-            _claim(order->manager, t.seller, min);
-
-            if (min == order->base) {
-                order = sorted_markets.erase(order);
-            } else if (min < order->base) {
-                sorted_markets.modify(order, _self, [&](auto &s) {
-                    s.base -= min;
+
+            if (!escrowed) {
+                settle.fill(seller, fill.maker, extended_asset(fill.in, taker_symbol), extended_asset(fill.out, order_symbol));
+            } else if (quote.side == ask) {
+                settle.cross(fill.maker, seller, extended_asset(fill.out, order_symbol), extended_asset(fill.in, taker_symbol));
+            } else {
+                settle.cross(seller, fill.maker, extended_asset(fill.in, taker_symbol), extended_asset(fill.out, order_symbol));
+            }
+            events.fill(pair.id, fill.id, fill.maker, quote.side, fill.price, fill.out, fill.in);
+            if (quote.side == ask) {
+                ticks.fill(pair.id, ask, fill.price, fill.out, fill.in);
+            } else {
+                ticks.fill(pair.id, bid, fill.price, fill.in, fill.out);
+            }
+
+            // a ladder's fills come one level at a time, so each finds the row again
+            auto order = markets.find(fill.id);
+            auto rest = *order;
+            if (rest.take(fill.out)) {
+                TRACE_COUNT(rows_written, 1);
+                markets.modify(order, _self, [&](auto &s) {
+                    s = rest;
                 });
             } else {
-                eosio_assert(false, "incorrect state");
+                TRACE_COUNT(rows_erased, 1);
+                _erase_order(markets, *order);
             }
+        }
+
+        if (from_reserve) {
+            TRACE_COUNT(rows_written, 1);
+            reserves.modify(reserves.find(pair.id), 0, [&](auto &r) {
+                r = pool;
+            });
+        }
+    }
 
-            if (received == t.receive) break;
+    void exchange::_rest(account_name seller, const pair_t& pair, const asset& remainder, uint64_t price, uint32_t expiration,
+                         bool escrowed) {
+        // the remainder rests on the side holding its token; a plain order of
+        // the same manager, side, price and expiration grows instead. An
+        // escrowed remainder is allowed already and the exchange pays for its
+        // row, as the seller may not have signed the action
+        uint8_t side = remainder.symbol == pair.base_symbol ? ask : bid;
+        if (!escrowed) {
+            settle.allow(seller, extended_asset(remainder, _extended(remainder.symbol).contract));
+        }
+        ticks.rest(pair.id, side, price, remainder.amount);
+
+        auto markets = markets_table(_self, pair.id);
+        auto by_manager = markets.get_index<N(bymanager)>();
+        auto key = exchange_state::manager_key(seller, price);
+        auto existing = by_manager.lower_bound(key);
+        while (existing != by_manager.end() && existing->get_manager_price() == key
+               && (existing->side != side || existing->expiration != expiration || existing->levels > 0)) {
+            existing++;
         }
 
-        eosio_assert(received == t.receive, "unable to fill");
+        if (existing == by_manager.end() || existing->get_manager_price() != key) {
+            TRACE("create new trade\n");
+            TRACE_COUNT(rows_written, 1);
+            auto& order = *markets.emplace(escrowed ? _self : seller, [&](auto &s) {
+                s.id = markets.available_primary_key();
+                s.manager = seller;
+                s.side = side;
+                s.amount = remainder.amount;
+                s.price = price;
+                s.expiration = expiration;
+                s.step = 0;
+                s.levels = 0;
+                s.size = 0;
+            });
+            if (expiration) {
+                _list_expiring(pair.id, order, escrowed ? _self : seller);
+            }
+            events.rest(pair.id, order, remainder.amount);
+        } else {
+            TRACE("combine trades with same rate\n");
+            TRACE_COUNT(rows_written, 1);
+            by_manager.modify(existing, _self, [&](auto &s) {
+                s.amount += remainder.amount;
+            });
+            events.rest(pair.id, *existing, remainder.amount);
+        }
     }
 
-    void exchange::on(const limit_trade &t) {
-        // limit order: get maximum receive (base) for X sell (quote)
-        auto base_symbol = t.receive_symbol;
-        auto quote_symbol = t.sell.symbol;
+    void exchange::_release(const pair_t& pair, const exchange_state& order) {
+        _refund(pair, order);
+        for (auto level = order; ; level = level.next_level()) {
+            ticks.rest(pair.id, level.side, level.price, -level.amount);
+            if (level.levels == 0) break;
+        }
+    }
 
-        require_auth(t.seller);
-        eosio_assert(is_whitelisted(t.seller), "Account is not whitelisted");
-        eosio_assert(t.sell.is_valid(), "invalid sell amount");
-        eosio_assert(base_symbol != quote_symbol, "invalid exchange");
+    void exchange::_refund(const pair_t& pair, const exchange_state& order) {
+        // hands a removed order's escrow back to its manager: revoked when the
+        // manager signed, claimed and returned by the exchange alone otherwise
+        auto escrow = extended_asset(order.total(), _extended(order.get_symbol(pair)));
+        if (has_auth(order.manager)) {
+            settle.allow(order.manager, -escrow);
+        } else {
+            settle.release(order.manager, escrow);
+        }
+        events.release(pair.id, order);
+    }
 
-        auto pairs = pairs_table(_self, _self);
-        auto existing_pair = pairs.end();
-        for (auto pair = pairs.begin(); pair != pairs.end(); pair++) {
-            if (pair->base_symbol == base_symbol && pair->quote_symbol == quote_symbol) {
-                existing_pair = pair;
-                break;
+    void exchange::_list_expiring(uint64_t pair_id, const exchange_state& order, account_name payer) {
+        expiring_table expiring(_self, pair_id);
+        TRACE_COUNT(rows_written, 1);
+        expiring.emplace(payer, [&](auto &e) {
+            e.id = order.id;
+            e.expiration = order.expiration;
+        });
+    }
+
+    void exchange::_erase_order(markets_table& markets, const exchange_state& order) {
+        if (order.expiration) {
+            expiring_table expiring(_self, markets.get_scope());
+            expiring.erase(expiring.get(order.id));
+        }
+        markets.erase(order);
+    }
+
+    void exchange::on(const createx &c) {
+        require_auth(c.creator);
+
+        const auto& pair = _order_pair(c.base_deposit.symbol, c.quote_deposit.symbol);
+        eosio_assert(is_whitelisted(c.creator), "Account is not whitelisted");
+
+        _create(c.creator, pair, c.base_deposit, c.quote_deposit, c.expiration);
+    }
+
+    void exchange::on(const createmany &c) {
+        require_auth(c.creator);
+        eosio_assert(is_whitelisted(c.creator), "Account is not whitelisted");
+        eosio_assert(!c.levels.empty(), "no orders to create");
+
+        const pair_t* pair = nullptr;
+        for (const auto& level : c.levels) {
+            if (pair == nullptr || !pair->trades(level.base_deposit.symbol, level.quote_deposit.symbol)) {
+                pair = &_order_pair(level.base_deposit.symbol, level.quote_deposit.symbol);
             }
+            _create(c.creator, *pair, level.base_deposit, level.quote_deposit, 0);
         }
-        eosio_assert(existing_pair != pairs.end(), "Pair doesn't exist");
+    }
 
-        account_name base_contract = base_symbol == wu_symbol ? wu_contract : loyalty_contract;
-        account_name quote_contract = quote_symbol == wu_symbol ? wu_contract : loyalty_contract;
+    void exchange::on(const createladder &c) {
+        require_auth(c.creator);
 
-        markets_table markets(_self, existing_pair->id);
-        eosio_assert(t.sell.amount > 0, ("sell amount must be positive" + std::to_string(t.sell.amount)).c_str());
-        auto sold = asset(0, quote_symbol);
-        auto received = asset(0, base_symbol);
+        const auto& pair = _order_pair(c.size.symbol, c.receive_symbol);
+        eosio_assert(is_whitelisted(c.creator), "Account is not whitelisted");
+        eosio_assert(c.size.is_valid(), "invalid size");
+        eosio_assert(c.size.amount > 0, "size must be positive");
+        eosio_assert(c.levels > 0 && c.levels <= MAX_LADDER_LEVELS, "invalid number of levels");
+        eosio_assert(c.price > 0, "price must be positive");
+        eosio_assert(c.step > 0 || c.levels == 1, "step must be positive");
+        eosio_assert(c.expiration == 0 || c.expiration > now(), "expiration must be in the future");
+        eosio_assert((uint128_t) c.size.amount * c.levels <= asset::max_amount, "ladder holds too much");
+
+        uint8_t side = c.size.symbol == pair.base_symbol ? ask : bid;
+        uint128_t span = (uint128_t) c.step * (c.levels - 1);
+        if (side == ask) {
+            eosio_assert(span <= UINT64_MAX - c.price, "ladder runs past the highest price");
+        } else {
+            eosio_assert(span < c.price, "ladder runs past the lowest price");
+        }
 
-        auto sorted_markets = markets.get_index<N(byprice)>();
-        for (auto order = sorted_markets.begin(); order != sorted_markets.end(); ) {
-            if (order->manager == t.seller || order->quote_symbol != quote_symbol || order->base.symbol != base_symbol) {
-                order++;
-                continue;
+        // a ladder only adds liquidity; its best level must not cross the book
+        markets_table markets(_self, pair.id);
+        auto crossed = quote_sell(markets, nullptr, pair, c.creator, c.size, c.price, 1, now());
+        eosio_assert(crossed.fills.empty(), "ladder would cross the book");
+
+        TRACE("create new ladder\n");
+        TRACE_COUNT(rows_written, 1);
+        auto& order = *markets.emplace(c.creator, [&](auto &s) {
+            s.id = markets.available_primary_key();
+            s.manager = c.creator;
+            s.side = side;
+            s.amount = c.size.amount;
+            s.price = c.price;
+            s.expiration = c.expiration;
+            s.step = c.step;
+            s.levels = c.levels - 1;
+            s.size = c.size.amount;
+        });
+        if (c.expiration) {
+            _list_expiring(pair.id, order, c.creator);
+        }
+        settle.allow(c.creator, extended_asset(order.total(), _extended(c.size.symbol)));
+        events.rest(pair.id, order, order.total());
+        for (auto level = order; ; level = level.next_level()) {
+            ticks.rest(pair.id, side, level.price, level.amount);
+            if (level.levels == 0) break;
+        }
+    }
+
+    const pair_t& exchange::_order_pair(symbol_type a, symbol_type b) {
+        bool a_is_quote = tokens::is_quote(a);
+        bool b_is_quote = tokens::is_quote(b);
+        if (a_is_quote && !b_is_quote) {
+            eosio_assert(lt_symbols.find(b) != lt_symbols.end(), "There is no such loyalty token");
+        } else if (!a_is_quote && b_is_quote) {
+            eosio_assert(lt_symbols.find(a) != lt_symbols.end(), "There is no such loyalty token");
+        } else {
+            eosio_assert(false, "One of the tokens must be WU, another token of loyalty");
+        }
+
+        // add pair if doesn't exist; the loyalty token is the base, priced in the quote token
+        auto existing_pair = find_pair(a, b);
+        if (existing_pair == pairs.end()) {
+            existing_pair = pairs.emplace(_self, [&](auto& p) {
+                p.id = pairs.available_primary_key();
+                p.base_symbol = a_is_quote ? b : a;
+                p.quote_symbol = a_is_quote ? a : b;
+            });
+        }
+        return *existing_pair;
+    }
+
+    void exchange::_create(account_name creator, const pair_t& pair, const asset& deposit, const asset& want, uint32_t expiration) {
+        eosio_assert(deposit.is_valid(), "invalid base deposit");
+        eosio_assert(deposit.amount > 0, "base deposit must be positive");
+        eosio_assert(want.is_valid(), "invalid quote deposit");
+        eosio_assert(want.amount > 0, "quote deposit must be positive");
+        eosio_assert(expiration == 0 || expiration > now(), "expiration must be in the future");
+
+        TRACE("base: ", _extended(deposit.symbol), '\n');
+        TRACE("quote: ", _extended(want.symbol), '\n');
+
+        // rounded so the order never gets less than it asks: asks up, bids down
+        uint64_t price;
+        if (deposit.symbol == pair.base_symbol) {
+            price = exchange_state::price_of(deposit, want, true);
+        } else {
+            price = exchange_state::price_of(want, deposit, false);
+        }
+
+        _place(creator, pair, deposit, price, expiration, false);
+    }
+
+    void exchange::_place(account_name creator, const pair_t& pair, const asset& deposit, uint64_t price, uint32_t expiration,
+                          bool escrowed) {
+        // take whatever the order crosses first, at the resting orders' prices
+        auto taken = _sell(creator, pair, deposit, price, 0, escrowed);
+        if (taken.sold != deposit) {
+            _rest(creator, pair, deposit - taken.sold, price, expiration, escrowed);
+        }
+    }
+
+    void exchange::on(const cancelx &c) {
+        const auto& existing_pair = get_pair(c.base_symbol, c.quote_symbol);
+        markets_table markets(_self, existing_pair.id);
+        auto market = markets.find(c.id);
+        eosio_assert(market != markets.end(), "order doesn't exist");
+
+        require_auth(market->manager);
+        _release(existing_pair, *market);
+        TRACE_COUNT(rows_erased, 1);
+        _erase_order(markets, *market);
+    }
+
+    void exchange::on(const cancelmany &c) {
+        require_auth(c.manager);
+
+        const auto& existing_pair = get_pair(c.base_symbol, c.quote_symbol);
+        markets_table markets(_self, existing_pair.id);
+        for (auto id : c.ids) {
+            auto market = markets.find(id);
+            eosio_assert(market != markets.end(), "order doesn't exist");
+            eosio_assert(market->manager == c.manager, "order belongs to another account");
+
+            _release(existing_pair, *market);
+            TRACE_COUNT(rows_erased, 1);
+            _erase_order(markets, *market);
+        }
+    }
+
+    void exchange::on(const cancelall &c) {
+        require_auth(c.manager);
+
+        const auto& existing_pair = get_pair(c.base_symbol, c.quote_symbol);
+        markets_table markets(_self, existing_pair.id);
+        // only the manager's rows are visited; the refunds net into one allowclaim per token
+        auto by_manager = markets.get_index<N(bymanager)>();
+        for (auto market = by_manager.lower_bound(exchange_state::manager_key(c.manager, 0));
+             market != by_manager.end() && market->manager == c.manager; ) {
+            TRACE_COUNT(rows_visited, 1);
+            const auto& order = *market++;
+            _release(existing_pair, order);
+            TRACE_COUNT(rows_erased, 1);
+            _erase_order(markets, order);
+        }
+    }
+
+    void exchange::on(const purge &p) {
+        // anyone may sweep expired orders; the makers get their escrow back
+        eosio_assert(p.limit > 0, "limit must be positive");
+
+        const auto& existing_pair = get_pair(p.base_symbol, p.quote_symbol);
+        markets_table markets(_self, existing_pair.id);
+        expiring_table expiring(_self, existing_pair.id);
+        auto by_expiry = expiring.get_index<N(byexpiry)>();
+        uint64_t purged = 0;
+        for (auto entry = by_expiry.begin(); entry != by_expiry.end() && purged < p.limit; purged++) {
+            TRACE_COUNT(rows_visited, 1);
+            if (entry->expiration > now()) break;
+            auto market = markets.find(entry->id);
+            _release(existing_pair, *market);
+            TRACE_COUNT(rows_erased, 2);
+            markets.erase(market);
+            entry = by_expiry.erase(entry);
+        }
+        eosio_assert(purged > 0, "no expired orders");
+    }
+
+    void exchange::on(const clear &c) {
+        eosio_assert(c.max_orders > 0, "max_orders must be positive");
+
+        const auto& pair = get_pair(c.base_symbol, c.quote_symbol);
+        pending_table pending(_self, pair.id);
+        vector<auction_order> bids;
+        vector<auction_order> asks;
+        uint64_t highest_bid = 0;
+        uint64_t lowest_ask = UINT64_MAX;
+        for (auto order = pending.begin(); order != pending.end() && bids.size() + asks.size() < c.max_orders; ) {
+            auction_order queued{order->id, order->owner, false, order->side, order->amount, order->price};
+            if (order->side == ask) {
+                asks.push_back(queued);
+                lowest_ask = std::min(lowest_ask, order->price);
+            } else {
+                bids.push_back(queued);
+                highest_bid = std::max(highest_bid, order->price);
             }
-            extended_asset estimated_to_sold = extended_asset(t.sell - sold, quote_contract);
-            auto quote = order->convert(extended_asset(order->base, base_contract), extended_symbol(order->quote_symbol, quote_contract));
-            auto min = min_asset(extended_asset(quote, quote_contract), estimated_to_sold);
-            sold += min;
-
-            extended_asset output;
-            if (min == quote) {
-                output = extended_asset(order->base, base_contract);
+            TRACE_COUNT(rows_erased, 1);
+            order = pending.erase(order);
+        }
+        eosio_assert(!bids.empty() || !asks.empty(), "no pending orders");
+
+        // only book orders the queue can reach take part
+        markets_table markets(_self, pair.id);
+        auto by_price = markets.get_index<N(byprice)>();
+        auto add_book = [&](uint8_t side, uint64_t limit, vector<auction_order>& orders) {
+            uint64_t read = 0;
+            auto first = exchange_state::priority_key(side, side == ask ? 0 : UINT64_MAX, 0);
+            for (auto order = by_price.lower_bound(first);
+                 order != by_price.end() && order->side == side && read < c.max_orders; order++, read++) {
+                TRACE_COUNT(rows_visited, 1);
+                if (side == ask ? order->price > limit : order->price < limit) break;
+                if (order->is_expired(now())) continue;
+                // each ladder level the queue reaches takes part on its own
+                for (auto level = *order; ; level = level.next_level()) {
+                    orders.push_back(auction_order{level.id, level.manager, true, side, level.amount, level.price});
+                    if (level.levels == 0 || (side == ask ? level.price + level.step > limit : level.price - level.step < limit)) break;
+                }
+            }
+        };
+        if (!bids.empty()) add_book(ask, highest_bid, asks);
+        if (!asks.empty()) add_book(bid, lowest_ask, bids);
+
+        auto result = run_auction(pair, bids, asks);
+        auto base_symbol = _extended(pair.base_symbol);
+        auto quote_symbol = _extended(pair.quote_symbol);
+        vector<int64_t> bids_left;
+        vector<int64_t> asks_left;
+        for (const auto& order : bids) bids_left.push_back(order.amount);
+        for (const auto& order : asks) asks_left.push_back(order.amount);
+        for (const auto& fill : result.fills) {
+            settle.cross(asks[fill.ask].owner, bids[fill.bid].owner,
+                         extended_asset(fill.base, base_symbol), extended_asset(fill.quote, quote_symbol));
+            ticks.trade(pair.id, result.price, fill.base, fill.quote);
+            // each side of the cross is a fill of its own order
+            const auto& seller = asks[fill.ask];
+            const auto& buyer = bids[fill.bid];
+            if (seller.resting) {
+                events.fill(pair.id, seller.id, seller.owner, ask, result.price, fill.base, fill.quote);
             } else {
-                output = order->convert(estimated_to_sold, extended_symbol(order->base.symbol, base_contract));
+                events.queued_fill(pair.id, seller.id, seller.owner, ask, result.price, fill.base, fill.quote);
             }
-//            extended_asset output = order->convert(min, extended_symbol(order->base.symbol, base_contract));
-            received += output;
-
-            print("min: ", min, "\n");
-            print("output: ", output, "\n");
-
-            _allowclaim(t.seller, min);
-            _claim(t.seller, order->manager, min);
-            _claim(order->manager, t.seller, output);
+            if (buyer.resting) {
+                events.fill(pair.id, buyer.id, buyer.owner, bid, result.price, fill.quote, fill.base);
+            } else {
+                events.queued_fill(pair.id, buyer.id, buyer.owner, bid, result.price, fill.quote, fill.base);
+            }
+            bids_left[fill.bid] -= fill.quote;
+            asks_left[fill.ask] -= fill.base;
+        }
 
-            if (min == quote) {
-                order = sorted_markets.erase(order);
-            } else if (min < quote) {
-                sorted_markets.modify(order, _self, [&](auto &s) {
-                    s.base -= output;
+        // book orders keep their place in the book; the levels of a ladder
+        // are taken best first, so what they lost comes off its front
+        boost::container::flat_map<uint64_t, int64_t> taken;
+        auto update_book = [&](const auction_order& order, int64_t left) {
+            if (!order.resting || left == order.amount) return;
+            ticks.rest(pair.id, order.side, order.price, left - order.amount);
+            taken[order.id] += order.amount - left;
+        };
+        // queued leftovers are placed like a good-till-cancel order at their
+        // limit, which only crosses book orders the auction didn't read. They
+        // stay escrowed, so anyone may run the auction without their owners
+        auto place_queued = [&](const auction_order& order, int64_t left) {
+            if (order.resting || left == 0) return;
+            auto remainder = asset(left, order.side == ask ? pair.base_symbol : pair.quote_symbol);
+            _place(order.owner, pair, remainder, order.price, 0, true);
+        };
+        for (size_t i = 0; i < bids.size(); i++) update_book(bids[i], bids_left[i]);
+        for (size_t i = 0; i < asks.size(); i++) update_book(asks[i], asks_left[i]);
+        for (const auto& item : taken) {
+            auto row = markets.find(item.first);
+            auto rest = *row;
+            if (rest.take(item.second)) {
+                TRACE_COUNT(rows_written, 1);
+                markets.modify(row, _self, [&](auto &s) {
+                    s = rest;
                 });
             } else {
-                eosio_assert(false, "incorrect state");
+                TRACE_COUNT(rows_erased, 1);
+                _erase_order(markets, *row);
             }
+        }
+        for (size_t i = 0; i < bids.size(); i++) place_queued(bids[i], bids_left[i]);
+        for (size_t i = 0; i < asks.size(); i++) place_queued(asks[i], asks_left[i]);
+
+        TRACE("price: ", result.price, " fills: ", (uint64_t) result.fills.size(), "\n");
+    }
+
+    void exchange::on(const quote &q) {
+        // read-only: nothing is written and no auth is needed, so clients can
+        // check a trade before sending it; seller only matters for skipping
+        // the seller's own orders
+        eosio_assert(q.sell.is_valid() && q.receive.is_valid(), "invalid quote amounts");
+        eosio_assert(q.sell.symbol != q.receive.symbol, "invalid exchange");
+        eosio_assert(q.sell.amount >= 0 && q.receive.amount >= 0, "quote amounts must not be negative");
+
+        if (q.receive.amount > 0) {
+            eosio_assert(q.sell.amount == 0, "quote either a sell or a receive amount");
+            const auto& pair = get_pair(q.receive.symbol, q.sell.symbol);
+            markets_table markets(_self, pair.id);
+            _print_quote(pair, quote_buy(markets, _reserve(pair), pair, q.seller, q.receive, q.max_fills, now()));
+            return;
+        }
 
-            if (sold == t.sell) break;
+        eosio_assert(q.sell.amount > 0, "quote either a sell or a receive amount");
+        auto direct = find_pair(q.receive.symbol, q.sell.symbol);
+        if (direct != pairs.end()) {
+            markets_table markets(_self, direct->id);
+            _print_quote(*direct, quote_sell(markets, _reserve(*direct), *direct, q.seller, q.sell, q.price, q.max_fills, now()));
+            return;
         }
 
-        eosio_assert(sold == t.sell, "unable to fill");
+        // the route trade takes; the legs use different books, so quoting
+        // the second against the unchanged book is what trade would get
+        const auto& first_pair = get_pair(wu_token::symbol, q.sell.symbol);
+        const auto& second_pair = get_pair(q.receive.symbol, wu_token::symbol);
+        markets_table first_markets(_self, first_pair.id);
+        auto first = quote_sell(first_markets, _reserve(first_pair), first_pair, q.seller, q.sell, 0, 0, now());
+        _print_quote(first_pair, first);
+        if (first.received.amount > 0) {
+            markets_table second_markets(_self, second_pair.id);
+            _print_quote(second_pair, quote_sell(second_markets, _reserve(second_pair), second_pair, q.seller, first.received, 0, 0, now()));
+        }
     }
 
-    void exchange::on(const trade &t) {
-        // get WU balance before trade
-        auto pairs = pairs_table(_self, _self);
-        auto existing_pair = pairs.end();
-        for (auto pair = pairs.begin(); pair != pairs.end(); pair++) {
-            if (pair->base_symbol == wu_symbol && pair->quote_symbol == t.sell.symbol) {
-                existing_pair = pair;
-                break;
+    void exchange::_print_quote(const pair_t& pair, const quote_t& quote) const {
+        // one line per book: what goes in and out, the average fixed-point
+        // quote per base it trades at, and how many orders and price levels
+        // it takes
+        uint64_t average = 0;
+        if (quote.sold.amount > 0 && quote.received.amount > 0) {
+            if (quote.side == ask) {
+                average = exchange_state::price_of(quote.received, quote.sold, true);
+            } else {
+                average = exchange_state::price_of(quote.sold, quote.received, false);
             }
         }
-        eosio_assert(existing_pair != pairs.end(), "Pair doesn't exist");
-        auto markets = markets_table(_self, existing_pair->id);
-        auto sorted_markets = markets.get_index<N(byprice)>();
-        auto order = sorted_markets.begin();
-        eosio_assert(order != sorted_markets.end(), "Markets doesn't exist");
+        uint64_t levels = 0;
+        for (size_t i = 0; i < quote.fills.size(); i++) {
+            if (i == 0 || quote.fills[i].price != quote.fills[i - 1].price) levels++;
+        }
+        print("pair: ", pair.id,
+              " sold: ", quote.sold,
+              " received: ", quote.received,
+              " price: ", average,
+              " fills: ", (uint64_t) quote.fills.size(),
+              " levels: ", levels, "\n");
+    }
 
-        auto wu_amount = order->convert(extended_asset(t.sell, loyalty_contract), extended_symbol(wu_symbol, wu_contract));
-        print("wu amount: ", wu_amount, '\n');
+    void exchange::on(const deposit &d) {
+        require_auth(d.owner);
+        eosio_assert(is_whitelisted(d.owner), "Account is not whitelisted");
+        eosio_assert(d.quantity.is_valid(), "invalid quantity");
+        eosio_assert(d.quantity.amount > 0, "quantity must be positive");
 
-        print("trade 1\n");
-        on(limit_trade{t.seller, t.sell, wu_symbol});
+        if (!tokens::is_quote(d.quantity.symbol)) {
+            eosio_assert(lt_symbols.find(d.quantity.symbol) != lt_symbols.end(), "There is no such loyalty token");
+        }
+        auto contract = tokens::contract_of(d.quantity.symbol);
+
+        balances_table balances(_self, d.owner);
+        if (balances.find(d.quantity.symbol.name()) == balances.end()) {
+            // once the row exists the account's orders settle against it, so
+            // nothing may still be escrowed through allowclaim
+            wu_balances accounts(contract, d.owner);
+            auto account = accounts.find(d.quantity.symbol.name());
+            eosio_assert(account == accounts.end() || account->blocked == 0, "Cancel resting orders before depositing");
+
+            balances.emplace(d.owner, [&](auto &b) {
+                b.balance = extended_asset(0, extended_symbol(d.quantity.symbol, contract));
+                b.reserved = 0;
+            });
+        }
 
-        print("trade 2\n");
-        on(limit_trade{t.seller, wu_amount, t.receive_symbol});
+        settle.deposit(d.owner, extended_asset(d.quantity, contract));
     }
 
-    void exchange::on(const createx &c) {
-        require_auth(c.creator);
+    void exchange::on(const withdraw &w) {
+        require_auth(w.owner);
+        eosio_assert(w.quantity.is_valid(), "invalid quantity");
+        eosio_assert(w.quantity.amount > 0, "quantity must be positive");
+
+        balances_table balances(_self, w.owner);
+        const auto& row = balances.get(w.quantity.symbol.name(), "No deposited balance");
+        eosio_assert(row.balance.symbol == w.quantity.symbol, "invalid quantity");
 
-        auto base_symbol = c.base_deposit.symbol;
-        auto quote_symbol = c.quote_deposit.symbol;
-        extended_asset base_deposit;
-        extended_asset quote_deposit;
+        settle.withdraw(w.owner, extended_asset(w.quantity, row.balance.contract));
+    }
 
-        bool base_is_wu = base_symbol == wu_symbol;
-        bool quote_is_wu = quote_symbol == wu_symbol;
-        if (base_is_wu && !quote_is_wu) {
-            eosio_assert(lt_symbols.find(quote_symbol) != lt_symbols.end(), "There is no such loyalty token");
+    void exchange::on(const addliquidity &a) {
+        require_auth(a.owner);
+        eosio_assert(is_whitelisted(a.owner), "Account is not whitelisted");
+        eosio_assert(a.base.is_valid() && a.quote.is_valid(), "invalid liquidity amounts");
+        eosio_assert(a.base.amount > 0 && a.quote.amount > 0, "liquidity amounts must be positive");
+
+        const auto& pair = _order_pair(a.base.symbol, a.quote.symbol);
+        eosio_assert(a.base.symbol == pair.base_symbol, "base must be the pair's loyalty token");
+
+        auto reserve = reserves.find(pair.id);
+        int64_t base = a.base.amount;
+        int64_t quote = a.quote.amount;
+        uint128_t shares;
+        if (reserve == reserves.end()) {
+            shares = isqrt((uint128_t) base * quote);
+        } else {
+            // shares rounded down and what they cost rounded up, so the
+            // providers already in never lose to a new one
+            shares = std::min((uint128_t) base * reserve->shares / reserve->base,
+                              (uint128_t) quote * reserve->shares / reserve->quote);
+            base = (int64_t) ((shares * reserve->base + reserve->shares - 1) / reserve->shares);
+            quote = (int64_t) ((shares * reserve->quote + reserve->shares - 1) / reserve->shares);
+        }
+        eosio_assert(shares > 0, "too little liquidity for a share");
+        eosio_assert(shares <= asset::max_amount, "too much liquidity");
 
-            base_deposit = extended_asset(c.base_deposit, wu_contract);
-            quote_deposit = extended_asset(c.quote_deposit, loyalty_contract);
-        } else if (!base_is_wu && quote_is_wu) {
-            eosio_assert(lt_symbols.find(base_symbol) != lt_symbols.end(), "There is no such loyalty token");
+        settle.charge(a.owner, extended_asset(base, _extended(pair.base_symbol)));
+        settle.charge(a.owner, extended_asset(quote, _extended(pair.quote_symbol)));
 
-            base_deposit = extended_asset(c.base_deposit, loyalty_contract);
-            quote_deposit = extended_asset(c.quote_deposit, wu_contract);
+        TRACE_COUNT(rows_written, 2);
+        if (reserve == reserves.end()) {
+            reserves.emplace(_self, [&](auto &r) {
+                r = reserve_t{pair.id, base, quote, (int64_t) shares};
+            });
         } else {
-            eosio_assert(false, "One of the tokens must be WU, another token of loyalty");
+            reserves.modify(reserve, 0, [&](auto &r) {
+                r.base += base;
+                r.quote += quote;
+                r.shares += (int64_t) shares;
+            });
         }
 
-        eosio_assert(is_whitelisted(c.creator), "Account is not whitelisted");
-        eosio_assert(base_deposit.is_valid(), "invalid base deposit");
-        eosio_assert(base_deposit.amount > 0, "base deposit must be positive");
-        eosio_assert(quote_deposit.is_valid(), "invalid quote deposit");
-        eosio_assert(quote_deposit.amount > 0, "quote deposit must be positive");
-
-        // add pair if doesn't exist
-        pairs_table pairs(_self, _self);
-        auto existing_pair = pairs.end();
-        for (auto itr = pairs.begin(); itr != pairs.end(); itr++) {
-            if (itr->base_symbol == base_symbol && itr->quote_symbol == quote_symbol) {
-                existing_pair = itr;
-                break;
-            }
+        liquidity_table providers(_self, pair.id);
+        auto provider = providers.find(a.owner);
+        if (provider == providers.end()) {
+            providers.emplace(a.owner, [&](auto &p) {
+                p.owner = a.owner;
+                p.shares = (int64_t) shares;
+            });
+        } else {
+            providers.modify(provider, 0, [&](auto &p) {
+                p.shares += (int64_t) shares;
+            });
         }
-        if (existing_pair == pairs.end()) {
-            auto id = pairs.available_primary_key();
-            pairs.emplace(_self, [&](auto& p) {
-                p.id = id;
-                p.base_symbol = base_symbol;
-                p.quote_symbol = quote_symbol;
+    }
+
+    void exchange::on(const remliquidity &r) {
+        require_auth(r.owner);
+        eosio_assert(r.shares > 0, "shares must be positive");
+
+        const auto& pair = get_pair(r.base_symbol, r.quote_symbol);
+        liquidity_table providers(_self, pair.id);
+        auto provider = providers.find(r.owner);
+        eosio_assert(provider != providers.end(), "No liquidity provided");
+        eosio_assert(provider->shares >= r.shares, "not that many shares");
+
+        // rounded down, so the shares left are never worth less
+        auto reserve = reserves.find(pair.id);
+        int64_t base = (int64_t) ((uint128_t) reserve->base * r.shares / reserve->shares);
+        int64_t quote = (int64_t) ((uint128_t) reserve->quote * r.shares / reserve->shares);
+        settle.credit(r.owner, extended_asset(base, _extended(pair.base_symbol)));
+        settle.credit(r.owner, extended_asset(quote, _extended(pair.quote_symbol)));
+
+        if (provider->shares == r.shares) {
+            TRACE_COUNT(rows_erased, 1);
+            providers.erase(provider);
+        } else {
+            TRACE_COUNT(rows_written, 1);
+            providers.modify(provider, 0, [&](auto &p) {
+                p.shares -= r.shares;
+            });
+        }
+        // the last shares take everything the reserve holds
+        if (reserve->shares == r.shares) {
+            TRACE_COUNT(rows_erased, 1);
+            reserves.erase(reserve);
+        } else {
+            TRACE_COUNT(rows_written, 1);
+            reserves.modify(reserve, 0, [&](auto &s) {
+                s.base -= base;
+                s.quote -= quote;
+                s.shares -= r.shares;
             });
-            existing_pair = pairs.find(id);
         }
+    }
+
+    void exchange::on(const eventlog &) {
+        // only a record in the action trace; the contract sends it itself
+        require_auth(_self);
+    }
 
-        _allowclaim(c.creator, base_deposit);
+    void exchange::cleanstate(uint64_t limit, bool reschedule) {
+        require_auth(this->_self);
+        eosio_assert(limit > 0, "limit must be positive");
+
+        // erases at most `limit` rows, resuming from the pair the last call
+        // stopped in. Nothing is dropped with funds behind it: orders and
+        // queued orders get their escrow back and providers their part of
+        // the reserve, the last provider what is left
+        cleanup_singleton cursor(_self, _self);
+        auto state = cursor.get_or_default(cleanup_t{0, 0});
+        uint64_t budget = limit;
+        tickers_table tickers(_self, _self);
+
+        for (auto pair = pairs.lower_bound(state.pair_id); pair != pairs.end() && budget > 0; ) {
+            state.pair_id = pair->id;
+            markets_table markets(_self, pair->id);
+            for (auto market = markets.begin(); market != markets.end() && budget > 0; budget--) {
+                const auto& order = *market++;
+                _refund(*pair, order);
+                _erase_order(markets, order);
+            }
+            pending_table pending(_self, pair->id);
+            for (auto order = pending.begin(); order != pending.end() && budget > 0; budget--) {
+                auto symbol = order->side == ask ? pair->base_symbol : pair->quote_symbol;
+                settle.release(order->owner, extended_asset(order->amount, _extended(symbol)));
+                order = pending.erase(order);
+            }
+            liquidity_table providers(_self, pair->id);
+            for (auto provider = providers.begin(); provider != providers.end() && budget > 0; budget--) {
+                auto reserve = reserves.find(pair->id);
+                int64_t base = (int64_t) ((uint128_t) reserve->base * provider->shares / reserve->shares);
+                int64_t quote = (int64_t) ((uint128_t) reserve->quote * provider->shares / reserve->shares);
+                settle.credit(provider->owner, extended_asset(base, _extended(pair->base_symbol)));
+                settle.credit(provider->owner, extended_asset(quote, _extended(pair->quote_symbol)));
+                reserves.modify(reserve, 0, [&](auto &r) {
+                    r.base -= base;
+                    r.quote -= quote;
+                    r.shares -= provider->shares;
+                });
+                provider = providers.erase(provider);
+            }
+            if (budget == 0) break;
 
-        print("base: ", base_deposit.get_extended_symbol(), '\n');
-        print("quote: ", quote_deposit.get_extended_symbol(), '\n');
+            auto ticker = tickers.find(pair->id);
+            if (ticker != tickers.end()) {
+                tickers.erase(ticker);
+            }
+            auto reserve = reserves.find(pair->id);
+            if (reserve != reserves.end()) {
+                eosio_assert(reserve->shares == 0, "reserve has shares without a provider");
+                reserves.erase(reserve);
+            }
+            pair = pairs.erase(pair);
+            budget--;
+        }
 
-        auto price = (double) (quote_deposit.amount * pow10(base_symbol.precision()))
-                / (base_deposit.amount * pow10(quote_symbol.precision()));
+        if (pairs.begin() == pairs.end()) {
+            for (auto account = whitelist.begin(); account != whitelist.end() && budget > 0; budget--) {
+                account = whitelist.erase(account);
+            }
+        }
 
-        auto markets = markets_table(_self, existing_pair->id);
-        auto existing = markets.end();
-        for (auto itr = markets.begin(); itr != markets.end(); itr++) {
-            if (itr->manager == c.creator && itr->price == price) {
-                existing = itr;
-                break;
+        // accounts proven against the Merkle root go with the root, or they
+        // would stay whitelisted once the whitelist is gone
+        verified_table verified(_self, _self);
+        whiteroot_singleton root(_self, _self);
+        if (pairs.begin() == pairs.end() && whitelist.begin() == whitelist.end()) {
+            for (auto account = verified.begin(); account != verified.end() && budget > 0; budget--) {
+                account = verified.erase(account);
+            }
+            if (verified.begin() == verified.end() && root.exists() && budget > 0) {
+                root.remove();
+                budget--;
             }
         }
+        state.erased += limit - budget;
 
-        if (existing == markets.end()) {
-            print("create new trade\n");
-            markets.emplace(c.creator, [&](auto &s) {
-                s.id = markets.available_primary_key();
-                s.manager = c.creator;
-                s.base = base_deposit;
-                s.quote_symbol = quote_symbol;
-                s.price = price;
-            });
+        if (pairs.begin() == pairs.end() && whitelist.begin() == whitelist.end() &&
+            verified.begin() == verified.end() && !root.exists()) {
+            cursor.remove();
+            return;
+        }
+        cursor.set(state, _self);
+
+        if (reschedule) {
+            transaction next;
+            next.actions.emplace_back(permission_level{_self, N(active)}, _self, N(cleanstate), std::make_tuple(limit, reschedule));
+            next.send(N(cleanstate), _self, true);
+        }
+    }
+
+    void exchange::migrate(uint64_t limit) {
+        require_auth(_self);
+        eosio_assert(limit > 0, "limit must be positive");
+
+        schema_singleton schema(_self, _self);
+        auto state = schema.get_or_default(schema_t{0});
+        eosio_assert(state.version < SCHEMA_VERSION, "Tables are already up to date");
+
+        // rewrites at most `limit` rows, resuming where the last call
+        // stopped. The version moves up as each step finishes, so the cursor
+        // always belongs to the step after it
+        migration_singleton progress(_self, _self);
+        auto cursor = progress.get_or_default(migration_t{0, 0, 0});
+        uint64_t budget = limit;
+        while (state.version < SCHEMA_VERSION && _migrate_step(state.version + 1, cursor, budget)) {
+            state.version++;
+            cursor = migration_t{0, 0, 0};
+        }
+        schema.set(state, _self);
+
+        if (state.version == SCHEMA_VERSION) {
+            progress.remove();
         } else {
-            print("combine trades with same rate\n");
-            markets.modify(existing, _self, [&](auto &s) {
-                s.base += base_deposit;
-            });
+            progress.set(cursor, _self);
         }
     }
 
-    void exchange::on(const cancelx &c) {
-        pairs_table pairs(_self, _self);
-        auto existing_pair = pairs.end();
-        for (auto itr = pairs.begin(); itr != pairs.end(); itr++) {
-            if (itr->base_symbol == c.base_symbol && itr->quote_symbol == c.quote_symbol) {
-                existing_pair = itr;
-                break;
+    bool exchange::_migrate_step(uint64_t version, migration_t& cursor, uint64_t& budget) {
+        // Steps rewrite rows in place where they can, so makers keep paying
+        // for their own orders. A row that has to move, grow or change an
+        // index key type is re-created billed to the contract, as the chain
+        // bills added RAM only to accounts that authorized the action
+        switch (version) {
+            case 1:
+                return _migrate_pairs(cursor, budget);
+            case 2:
+                return _migrate_prices(cursor, budget);
+            case 3:
+                return _migrate_priority(cursor, budget);
+            case 4:
+                return _migrate_compact(cursor, budget);
+            case 5:
+                // existing orders never expire, and a row without an
+                // expiration reads as one that doesn't
+                return true;
+            case 6:
+                return _migrate_sides(cursor, budget);
+            case 7:
+                // single levels are rows that end before the ladder fields
+                return true;
+            case 8:
+                return _migrate_expiring(cursor, budget);
+        }
+        eosio_assert(false, "unknown schema version");
+        return false;
+    }
+
+    template<typename Table, typename Migrate>
+    bool exchange::_migrate_markets(migration_t& cursor, uint64_t& budget, Migrate&& migrate) {
+        for (auto pair = pairs.lower_bound(cursor.pair_id); pair != pairs.end(); pair++) {
+            if (pair->id != cursor.pair_id) {
+                cursor = migration_t{cursor.phase, pair->id, 0};
+            }
+            Table markets(_self, pair->id);
+            for (auto itr = markets.lower_bound(cursor.id); itr != markets.end(); budget--) {
+                if (budget == 0) return false;
+                const auto& row = *itr++;
+                cursor.id = row.id + 1;
+                migrate(*pair, markets, row);
             }
         }
-        markets_table markets(_self, existing_pair->id);
-        auto market = markets.find(c.id);
-        eosio_assert(market != markets.end(), "order doesn't exist");
+        return true;
+    }
 
-        require_auth(market->manager);
-        account_name base_contract = c.base_symbol == wu_symbol ? wu_contract : loyalty_contract;
-        _allowclaim(market->manager, extended_asset(-market->base, base_contract));
-        markets.erase(market);
+    bool exchange::_migrate_pairs(migration_t& cursor, uint64_t& budget) {
+        // rows stored before the bysymbols index existed have no secondary
+        // entry, so they are read through the legacy layout and re-inserted
+        // through a table object of their own; `pairs` never caches a row
+        // erased under it
+        legacy_pairs_table legacy(_self, _self);
+        pairs_table indexed(_self, _self);
+        auto by_symbols = indexed.get_index<N(bysymbols)>();
+        for (auto itr = legacy.lower_bound(cursor.pair_id); itr != legacy.end(); budget--) {
+            if (budget == 0) return false;
+            const auto& row = *itr++;
+            auto pair = row;
+            cursor.pair_id = pair.id + 1;
+
+            auto entry = by_symbols.find(pair.get_symbols());
+            if (entry != by_symbols.end() && entry->id == pair.id) continue;
+            legacy.erase(row);
+            indexed.emplace(_self, [&](auto& p) {
+                p = pair;
+            });
+        }
+        return true;
     }
 
-    void exchange::cleanstate() {
-        require_auth(this->_self);
+    bool exchange::_migrate_prices(migration_t& cursor, uint64_t& budget) {
+        // rows are re-created because the byprice index changes key type
+        return _migrate_markets<legacy_markets_table>(cursor, budget, [&](const pair_t& pair, auto& legacy, const auto& row) {
+            auto order = row;
+            legacy.erase(row);
+            priced_markets_table markets(_self, pair.id);
+            markets.emplace(_self, [&](auto& s) {
+                s.id = order.id;
+                s.manager = order.manager;
+                s.base = order.base;
+                s.quote_symbol = order.quote_symbol;
+                s.price = (uint64_t) (order.price * PRICE_SCALE + 0.5);
+            });
+        });
+    }
 
-        pairs_table pairs(_self, _self);
-        for (auto pair = pairs.begin(); pair != pairs.end(); ) {
-            markets_table markets(_self, pair->id);
-            for (auto market = markets.begin(); market != markets.end(); ) {
-                market = markets.erase(market);
-            }
+    bool exchange::_migrate_priority(migration_t& cursor, uint64_t& budget) {
+        // byprice changes key type again and bymanager is new, so rows are
+        // re-created the same way as in _migrate_prices
+        return _migrate_markets<priced_markets_table>(cursor, budget, [&](const pair_t& pair, auto& priced, const auto& row) {
+            auto order = row;
+            priced.erase(row);
+            wide_markets_table markets(_self, pair.id);
+            markets.emplace(_self, [&](auto& s) {
+                s = order;
+            });
+        });
+    }
 
-            pair = pairs.erase(pair);
+    bool exchange::_migrate_compact(migration_t& cursor, uint64_t& budget) {
+        // the row format changes while the index keys stay the same, so rows
+        // are read through the wide layout and written back compact
+        return _migrate_markets<wide_markets_table>(cursor, budget, [&](const pair_t& pair, auto& wide, const auto& row) {
+            auto order = row;
+            wide.erase(row);
+            perpetual_markets_table markets(_self, pair.id);
+            markets.emplace(_self, [&](auto& s) {
+                s.id = order.id;
+                s.manager = order.manager;
+                s.amount = order.base.amount;
+                s.price = order.price;
+            });
+        });
+    }
+
+    bool exchange::_migrate_sides(migration_t& cursor, uint64_t& budget) {
+        // every pair used to be one side of its own book. Pairs with WU as
+        // the quote keep their orders as asks; the orders of a WU-based pair
+        // sell WU, so they become bids of the loyalty token's pair, priced
+        // as the inverse and rounded down so the maker still gets at least
+        // what it asked. Rows gain the side byte, so all are re-created.
+        //
+        // Phase 0 drops the old tickers, 1 turns the WU-quoted books around,
+        // 2 moves or flips the WU-based ones, each pair row once its book is
+        // done, and 3 rebuilds the tickers from the migrated books
+        if (cursor.phase == 0) {
+            one_sided_tickers_table old_tickers(_self, _self);
+            for (auto itr = old_tickers.begin(); itr != old_tickers.end(); budget--) {
+                if (budget == 0) return false;
+                itr = old_tickers.erase(itr);
+            }
+            cursor = migration_t{1, 0, 0};
         }
 
-        for (auto account = whitelist.begin(); account != whitelist.end(); ) {
-            account = whitelist.erase(account);
+        if (cursor.phase == 1) {
+            for (auto pair = pairs.lower_bound(cursor.pair_id); pair != pairs.end(); pair++) {
+                if (pair->quote_symbol != wu_token::symbol) continue;
+                if (pair->id != cursor.pair_id) {
+                    cursor = migration_t{1, pair->id, 0};
+                }
+                one_sided_markets_table old_markets(_self, pair->id);
+                markets_table markets(_self, pair->id);
+                for (auto itr = old_markets.lower_bound(cursor.id); itr != old_markets.end(); budget--) {
+                    if (budget == 0) return false;
+                    const auto& row = *itr++;
+                    auto order = row;
+                    cursor.id = order.id + 1;
+                    old_markets.erase(row);
+                    markets.emplace(_self, [&](auto& s) {
+                        s.id = order.id;
+                        s.manager = order.manager;
+                        s.side = ask;
+                        s.amount = order.amount;
+                        s.price = order.price;
+                        s.expiration = order.expiration;
+                        s.step = 0;
+                        s.levels = 0;
+                        s.size = 0;
+                    });
+                }
+            }
+            cursor = migration_t{2, 0, 0};
         }
-    }
 
-    void exchange::_allowclaim(account_name owner, extended_asset quantity) {
-        struct allowclaim {
-            account_name from;
-            asset quantity;
-        };
+        if (cursor.phase == 2) {
+            for (auto pair = pairs.lower_bound(cursor.pair_id); pair != pairs.end(); ) {
+                if (pair->quote_symbol == wu_token::symbol) {
+                    pair++;
+                    continue;
+                }
+                if (pair->id != cursor.pair_id) {
+                    cursor = migration_t{2, pair->id, 0};
+                }
+
+                // the pair is turned around unless the loyalty token already has one
+                auto target = find_pair(pair->quote_symbol, pair->base_symbol);
+                uint64_t target_id = target == pairs.end() ? pair->id : target->id;
+                one_sided_markets_table old_markets(_self, pair->id);
+                markets_table markets(_self, target_id);
+                for (auto itr = old_markets.lower_bound(cursor.id); itr != old_markets.end(); budget--) {
+                    if (budget == 0) return false;
+                    const auto& row = *itr++;
+                    auto order = row;
+                    cursor.id = order.id + 1;
+                    old_markets.erase(row);
+
+                    uint128_t price = scaled_div(PRICE_SCALE, PRICE_PRECISION, order.price, false);
+                    eosio_assert(price > 0 && price <= UINT64_MAX, "price out of range");
+                    markets.emplace(_self, [&](auto& s) {
+                        s.id = target_id == pair->id ? order.id : markets.available_primary_key();
+                        s.manager = order.manager;
+                        s.side = bid;
+                        s.amount = order.amount;
+                        s.price = (uint64_t) price;
+                        s.expiration = order.expiration;
+                        s.step = 0;
+                        s.levels = 0;
+                        s.size = 0;
+                    });
+                }
+
+                if (budget == 0) return false;
+                budget--;
+                if (target == pairs.end()) {
+                    auto base_symbol = pair->base_symbol;
+                    pairs.modify(pair, _self, [&](auto& p) {
+                        p.base_symbol = p.quote_symbol;
+                        p.quote_symbol = base_symbol;
+                    });
+                    pair++;
+                } else {
+                    pair = pairs.erase(pair);
+                }
+            }
+            cursor = migration_t{3, 0, 0};
+        }
 
-        action(eosio::vector<permission_level>{
-                   permission_level(owner, N(active)),
-                   permission_level(_self, N(active))
-               },
-               quantity.contract,
-               N(allowclaim),
-               allowclaim{owner, quantity}).send();
-    }
-
-    void exchange::_claim(account_name owner,
-                          account_name to,
-                          extended_asset quantity) {
-        struct claim {
-            account_name from;
-            asset quantity;
-        };
+        for (auto pair = pairs.lower_bound(cursor.pair_id); pair != pairs.end(); pair++, budget--) {
+            if (budget == 0) return false;
+            cursor.pair_id = pair->id + 1;
+            ticks.rest(pair->id, ask, 0, 0);
+        }
+        return true;
+    }
 
-        struct transfer {
-            account_name from;
-            account_name to;
-            asset quantity;
-            std::string memo;
-        };
+    bool exchange::_migrate_expiring(migration_t& cursor, uint64_t& budget) {
+        // rows are rewritten in place, so they keep their payers and only
+        // shrink: the ones with every field stored drop the fields their
+        // orders don't use. Their byexpiry entries go, as the layout no
+        // longer declares the index, and the orders that expire are listed
+        // in `expiring` instead
+        uint64_t index = (N(markets) & 0xFFFFFFFFFFFFFFF0ULL) | LEGACY_EXPIRY_INDEX;
+        return _migrate_markets<markets_table>(cursor, budget, [&](const pair_t& pair, auto& markets, const auto& order) {
+            uint64_t expiry;
+            auto entry = db_idx64_find_primary(_self, pair.id, index, &expiry, order.id);
+            if (entry >= 0) {
+                db_idx64_remove(entry);
+            }
+            markets.modify(order, 0, [](auto&) {});
+            if (order.expiration) {
+                _list_expiring(pair.id, order, _self);
+            }
+        });
+    }
 
-        action(permission_level(_self, N(active)),
-               quantity.contract,
-               N(claim),
-               claim{owner, quantity}).send();
+    pairs_table::const_iterator exchange::find_pair(symbol_type a, symbol_type b) const {
+        // pairs are stored with the quote token second
+        if (tokens::is_quote(a)) {
+            std::swap(a, b);
+        }
+        auto by_symbols = pairs.get_index<N(bysymbols)>();
+        auto itr = by_symbols.find(pair_t::symbols_key(a, b));
+        return itr == by_symbols.end() ? pairs.end() : pairs.iterator_to(*itr);
+    }
 
-        action(permission_level(_self, N(active)),
-               quantity.contract,
-               N(transfer),
-               transfer{_self, to, quantity, "claim"}).send();
-    };
+    const pair_t& exchange::get_pair(symbol_type a, symbol_type b) const {
+        auto itr = find_pair(a, b);
+        eosio_assert(itr != pairs.end(), "Pair doesn't exist");
+        return *itr;
+    }
 
     void exchange::apply(account_name contract, account_name act) {
         if (contract != _self)
             return;
+        TRACE_RESET();
 
         auto &thiscontract = *this;
         switch (act) {
-            EOSIO_API(exchange, (white)(unwhite)(whitemany)(unwhitemany)(cleanstate))
+            EOSIO_API(exchange, (white)(unwhite)(whitemany)(unwhitemany)(whiteroot)(whiteproof)(cleanstate)(migrate))
         };
 
         switch (act) {
             case N(createx):
                 on(unpack_action_data<createx>());
-                return;
+                break;
             case N(spec.trade):
                 on(unpack_action_data<spec_trade>());
-                return;
+                break;
             case N(market.trade):
                 on(unpack_action_data<market_trade>());
-                return;
+                break;
             case N(limit.trade):
                 on(unpack_action_data<limit_trade>());
-                return;
+                break;
             case N(trade):
                 on(unpack_action_data<trade>());
-                return;
+                break;
+            case N(createmany):
+                on(unpack_action_data<createmany>());
+                break;
+            case N(createladder):
+                on(unpack_action_data<createladder>());
+                break;
             case N(cancelx):
                 on(unpack_action_data<cancelx>());
-                return;
+                break;
+            case N(cancelmany):
+                on(unpack_action_data<cancelmany>());
+                break;
+            case N(cancelall):
+                on(unpack_action_data<cancelall>());
+                break;
+            case N(purge):
+                on(unpack_action_data<purge>());
+                break;
+            case N(clear):
+                on(unpack_action_data<clear>());
+                break;
+            case N(quote):
+                on(unpack_action_data<quote>());
+                break;
+            case N(deposit):
+                on(unpack_action_data<deposit>());
+                break;
+            case N(withdraw):
+                on(unpack_action_data<withdraw>());
+                break;
+            case N(addliquidity):
+                on(unpack_action_data<addliquidity>());
+                break;
+            case N(remliquidity):
+                on(unpack_action_data<remliquidity>());
+                break;
+            case N(eventlog):
+                on(unpack_action_data<eventlog>());
+                break;
         }
+
+        ticks.flush();
+        settle.flush();
+        events.flush();
     }
 } /// namespace eosio
 
@@ -5,8 +5,12 @@
 #include <boost/container/flat_map.hpp>
 #include "exchange_state.hpp"
 #include "whitelisted.hpp"
-#include "str_expand.h"
-#include "config.h"
+#include "settlement.hpp"
+#include "ticker.hpp"
+#include "matching.hpp"
+#include "auction.hpp"
+#include "events.hpp"
+#include "tokens.hpp"
 
 namespace eosio {
 
@@ -14,14 +18,12 @@ namespace eosio {
     public:
         exchange(account_name self)
                 : whitelisted(self)
-                , wu_contract(string_to_name(STR(WU_ACCOUNT)))
-                , wu_symbol(string_to_symbol(WU_DECIMALS, STR(WU_SYMBOL)))
-                , loyalty_contract(string_to_name(STR(LT_ACCOUNT)))
-                , lt_symbols(loyalty_contract, loyalty_contract) {}
-
-        account_name wu_contract;
-        symbol_type wu_symbol;
-        account_name loyalty_contract;
+                , lt_symbols(LOYALTY_CONTRACT, LOYALTY_CONTRACT)
+                , pairs(self, self)
+                , reserves(self, self)
+                , settle(self)
+                , ticks(self)
+                , events(self) {}
 
         struct spec_trade {
             uint64_t id;
@@ -30,22 +32,41 @@ namespace eosio {
             asset receive;
         };
 
+        // what a taking order does with the part the book can't fill; batch
+        // orders don't match at all but wait in `pending` for the pair's next
+        // `clear`, and what that leaves rests like good-till-cancel
+        enum time_in_force : uint8_t {
+            fill_or_kill = 0,
+            immediate_or_cancel = 1,
+            good_till_cancel = 2,
+            batch = 3
+        };
+
+        // max_fills bounds the orders matched by one action, 0 for no bound
         struct market_trade {
             account_name seller;
             symbol_type sell_symbol;
             asset receive;
+            uint8_t tif;
+            uint16_t max_fills;
         };
 
+        // price is the pair's quote per base: at most that when selling quote,
+        // at least that when selling base, 0 for no limit; good-till-cancel
+        // orders need one and rest their remainder at it
         struct limit_trade {
             account_name seller;
             asset sell;
             symbol_type receive_symbol;
+            uint64_t price;
+            uint8_t tif;
+            uint16_t max_fills;
         };
 
         struct trade {
             account_name seller;
             asset sell;
-            symbol_type receive_symbol;
+            asset min_receive;
         };
 
         struct cancelx {
@@ -54,14 +75,115 @@ namespace eosio {
             symbol_type quote_symbol;
         };
 
+        // sells base_deposit for quote_deposit, whichever of the two is the
+        // pair's base; the order first takes any opposite orders it crosses
+        // and only the remainder rests. expiration is a time in seconds after
+        // which the order can no longer fill and anyone may purge it, 0 to
+        // rest indefinitely
         struct createx {
             account_name creator;
             asset base_deposit;
             asset quote_deposit;
+            uint32_t expiration;
+        };
+
+        struct level {
+            asset base_deposit;
+            asset quote_deposit;
+        };
+
+        struct createmany {
+            account_name creator;
+            vector<level> levels;
+        };
+
+        // rests `levels` orders of size each as one row: the first at price,
+        // every next one step further from the other side. The best level
+        // must not cross the book
+        struct createladder {
+            account_name creator;
+            asset size;
+            symbol_type receive_symbol;
+            uint64_t price;
+            uint64_t step;
+            uint16_t levels;
+            uint32_t expiration;
+        };
+
+        struct cancelmany {
+            account_name manager;
+            symbol_type base_symbol;
+            symbol_type quote_symbol;
+            vector<uint64_t> ids;
+        };
+
+        struct cancelall {
+            account_name manager;
+            symbol_type base_symbol;
+            symbol_type quote_symbol;
+        };
+
+        struct purge {
+            symbol_type base_symbol;
+            symbol_type quote_symbol;
+            uint64_t limit;
+        };
+
+        // runs the pair's batch auction over up to max_orders queued orders,
+        // oldest first, and as many book orders per side; anyone may call it
+        struct clear {
+            symbol_type base_symbol;
+            symbol_type quote_symbol;
+            uint64_t max_orders;
+        };
+
+        // prints what a trade would do without doing it: buys receive when its
+        // amount is set, otherwise sells sell, routed through WU when the
+        // tokens share no pair; price and max_fills as for limit.trade
+        struct quote {
+            account_name seller;
+            asset sell;
+            asset receive;
+            uint64_t price;
+            uint16_t max_fills;
+        };
+
+        struct deposit {
+            account_name owner;
+            asset quantity;
+        };
+
+        struct withdraw {
+            account_name owner;
+            asset quantity;
+        };
+
+        // adds at most base and quote to the pair's reserve, creating both
+        // if needed; the first provider sets the ratio the reserve trades
+        // at, later ones put in as much as the ratio lets the smaller allow
+        struct addliquidity {
+            account_name owner;
+            asset base;
+            asset quote;
+        };
+
+        // pays out owner's share of the pair's reserve in both tokens
+        struct remliquidity {
+            account_name owner;
+            symbol_type base_symbol;
+            symbol_type quote_symbol;
+            int64_t shares;
         };
 
+        // the book events of one action, sent by the contract to itself
+        typedef event_batch eventlog;
+
         void on(const createx &c);
 
+        void on(const createmany &c);
+
+        void on(const createladder &c);
+
         void on(const spec_trade &t);
 
         void on(const market_trade &t);
@@ -72,11 +194,33 @@ namespace eosio {
 
         void on(const cancelx &c);
 
+        void on(const cancelmany &c);
+
+        void on(const cancelall &c);
+
+        void on(const purge &p);
+
+        void on(const clear &c);
+
+        void on(const quote &q);
+
+        void on(const deposit &d);
+
+        void on(const withdraw &w);
+
+        void on(const addliquidity &a);
+
+        void on(const remliquidity &r);
+
+        void on(const eventlog &e);
+
         void apply(account_name contract, account_name act);
 
         extended_asset convert(extended_asset from, extended_symbol to) const;
 
-        void cleanstate();
+        void cleanstate(uint64_t limit, bool reschedule);
+
+        void migrate(uint64_t limit);
     private:
         struct symbols_t {
             eosio::symbol_name symbol;
@@ -93,10 +237,86 @@ namespace eosio {
 
         typedef eosio::multi_index<N(accounts), account> wu_balances;
 
-        void _allowclaim(account_name owner, extended_asset quantity);
+        pairs_table pairs;
+
+        reserves_table reserves;
+
+        // the pair's reserve, nullptr while it has none
+        const reserve_t* _reserve(const pair_t& pair) const {
+            auto itr = reserves.find(pair.id);
+            return itr == reserves.end() ? nullptr : &*itr;
+        }
+
+        // one pair trades both ways between two tokens, so either order finds it
+        pairs_table::const_iterator find_pair(symbol_type a, symbol_type b) const;
+
+        const pair_t& get_pair(symbol_type a, symbol_type b) const;
+
+        // a migrate step takes rows off the budget as it rewrites them and
+        // returns whether it finished; the cursor is where it stopped
+        bool _migrate_step(uint64_t version, migration_t& cursor, uint64_t& budget);
+
+        // calls migrate(pair, markets, row) on every row of every pair's
+        // `markets` read through Table, from the cursor on. Rows keep their
+        // ids, so the cursor is the next id to read
+        template<typename Table, typename Migrate>
+        bool _migrate_markets(migration_t& cursor, uint64_t& budget, Migrate&& migrate);
+
+        bool _migrate_pairs(migration_t& cursor, uint64_t& budget);
+
+        bool _migrate_prices(migration_t& cursor, uint64_t& budget);
+
+        bool _migrate_priority(migration_t& cursor, uint64_t& budget);
+
+        bool _migrate_compact(migration_t& cursor, uint64_t& budget);
+
+        bool _migrate_sides(migration_t& cursor, uint64_t& budget);
+
+        bool _migrate_expiring(migration_t& cursor, uint64_t& budget);
+
+        quote_t _buy(account_name seller, const pair_t& pair, const asset& receive, uint16_t max_fills);
+
+        // an escrowed seller pays out of an earlier allowance, as a queued batch order does
+        quote_t _sell(account_name seller, const pair_t& pair, const asset& sell, uint64_t limit_price, uint16_t max_fills,
+                      bool escrowed);
+
+        void _execute(account_name seller, const pair_t& pair, markets_table& markets, const quote_t& quote, bool escrowed);
+
+        void _print_quote(const pair_t& pair, const quote_t& quote) const;
+
+        void _rest(account_name seller, const pair_t& pair, const asset& remainder, uint64_t price, uint32_t expiration,
+                   bool escrowed);
+
+        void _release(const pair_t& pair, const exchange_state& order);
+
+        // the part of _release that pays the escrow back, for callers that drop the ticker too
+        void _refund(const pair_t& pair, const exchange_state& order);
+
+        // lists an order that expires in `expiring`, billed to payer like its row
+        void _list_expiring(uint64_t pair_id, const exchange_state& order, account_name payer);
+
+        // erases an order's row together with its `expiring` entry
+        void _erase_order(markets_table& markets, const exchange_state& order);
+
+        static extended_symbol _extended(symbol_type symbol) {
+            return extended_symbol(symbol, tokens::contract_of(symbol));
+        }
+
+        settlement settle;
+
+        tickers ticks;
+
+        book_events events;
+
+        // the pair trading the two tokens, in either order, created on first use
+        const pair_t& _order_pair(symbol_type a, symbol_type b);
+
+        void _create(account_name creator, const pair_t& pair, const asset& deposit, const asset& want, uint32_t expiration);
+
+        void _place(account_name creator, const pair_t& pair, const asset& deposit, uint64_t price, uint32_t expiration,
+                    bool escrowed);
 
-        void _claim(account_name owner,
-                    account_name to,
-                    extended_asset quantity);
+        // expired orders the match loops may still refund and erase in this action
+        uint16_t _purge_budget = PURGE_BUDGET;
     };
 } // namespace eosio
@@ -1,38 +1,187 @@
 #include "exchange_state.hpp"
 
+#include <algorithm>
+
 namespace eosio {
 
-    uint64_t pow10(uint64_t power) {
-        uint64_t result = 1;
-        for (uint64_t i = 0; i < power; i++) {
-            result *= 10;
+    // 10^power as a 128-bit value, built from the POW10 table
+    uint128_t pow10(uint64_t power) {
+        const uint64_t size = sizeof(POW10_TABLE) / sizeof(POW10_TABLE[0]);
+        eosio_assert(power <= 2 * (size - 1), "precision out of range");
+        if (power < size) {
+            return POW10_TABLE[power];
+        }
+        return (uint128_t) POW10_TABLE[size - 1] * POW10_TABLE[power - (size - 1)];
+    }
+
+    // amount * 10^exponent / divisor, rounded down or up
+    uint128_t scaled_div(uint128_t amount, int64_t exponent, uint128_t divisor, bool round_up) {
+        uint128_t multiplier = 1;
+        if (exponent >= 0) {
+            multiplier = pow10(exponent);
+        } else {
+            uint128_t scale = pow10(-exponent);
+            eosio_assert(divisor <= ((uint128_t) -1) / scale, "conversion overflow");
+            divisor *= scale;
+        }
+        eosio_assert(divisor > 0, "division by zero");
+        eosio_assert(amount <= ((uint128_t) -1) / multiplier, "conversion overflow");
+
+        uint128_t product = amount * multiplier;
+        uint128_t result = product / divisor;
+        if (round_up && product % divisor != 0) {
+            result++;
         }
         return result;
     }
 
-    extended_asset exchange_state::convert(extended_asset from, extended_symbol to_symbol) const {
-        double out;
+    // the largest r with r * r <= n
+    uint128_t isqrt(uint128_t n) {
+        if (n < 2) return n;
+        // Newton's method from above: 2^64 - 1 is at least the root of any n
+        uint128_t r = n < ((uint128_t) 1 << 64) ? n : UINT64_MAX;
+        while (true) {
+            uint128_t next = (r + n / r) / 2;
+            if (next >= r) return r;
+            r = next;
+        }
+    }
 
-        if (from.symbol == base.symbol && to_symbol == quote_symbol) {
-            out = from.amount * get_price();
-        } else if (from.symbol == quote_symbol && to_symbol == base.symbol) {
-            out = from.amount * get_rprice();
-        } else {
-            eosio_assert(false, "invalid conversion");
+    // base_amount * price in the pair's quote units
+    int64_t base_to_quote(const pair_t& pair, uint64_t price, int64_t base_amount, bool round_up) {
+        eosio_assert(base_amount >= 0, "invalid conversion");
+        int64_t exponent = (int64_t) pair.quote_symbol.precision() - PRICE_PRECISION - (int64_t) pair.base_symbol.precision();
+        uint128_t out = scaled_div((uint128_t) base_amount * price, exponent, 1, round_up);
+        eosio_assert(out <= asset::max_amount, "conversion overflow");
+        return (int64_t) out;
+    }
+
+    // quote_amount / price in the pair's base units
+    int64_t quote_to_base(const pair_t& pair, uint64_t price, int64_t quote_amount, bool round_up) {
+        eosio_assert(quote_amount >= 0, "invalid conversion");
+        int64_t exponent = PRICE_PRECISION + (int64_t) pair.base_symbol.precision() - (int64_t) pair.quote_symbol.precision();
+        uint128_t out = scaled_div(quote_amount, exponent, price, round_up);
+        eosio_assert(out <= asset::max_amount, "conversion overflow");
+        return (int64_t) out;
+    }
+
+    // rounding always favours the maker: it is owed the rounded-up amount
+    // and pays out the rounded-down one
+    int64_t exchange_state::pays_for(const pair_t& pair, int64_t out) const {
+        return side == ask ? base_to_quote(pair, price, out, true) : quote_to_base(pair, price, out, true);
+    }
+
+    int64_t exchange_state::paid_by(const pair_t& pair, int64_t in) const {
+        return side == ask ? quote_to_base(pair, price, in, false) : base_to_quote(pair, price, in, false);
+    }
+
+    uint64_t exchange_state::price_of(const asset& base, const asset& quote, bool round_up) {
+        eosio_assert(base.amount > 0 && quote.amount > 0, "invalid price");
+        int64_t exponent = PRICE_PRECISION + (int64_t) base.symbol.precision() - (int64_t) quote.symbol.precision();
+        uint128_t price = scaled_div(quote.amount, exponent, base.amount, round_up);
+        eosio_assert(price > 0 && price <= UINT64_MAX, "price out of range");
+        return (uint64_t) price;
+    }
+
+    exchange_state exchange_state::next_level() const {
+        auto next = *this;
+        next.price = side == ask ? price + step : price - step;
+        next.amount = size;
+        next.levels--;
+        return next;
+    }
+
+    bool exchange_state::take(int64_t out) {
+        amount -= out;
+        while (amount <= 0 && levels > 0) {
+            int64_t carried = amount;
+            *this = next_level();
+            amount += carried;
         }
+        eosio_assert(amount >= 0, "order can't pay out that much");
+        return amount > 0;
+    }
+
+    // the taker's payment that leaves at least y * out / (x - out) in a
+    // reserve holding x and taking y once the fee is off, rounded up
+    uint128_t reserve_payment(int64_t x, int64_t y, int64_t out) {
+        uint128_t kept = ((uint128_t) y * out + (x - out) - 1) / (x - out);
+        return (kept * 10000 + (10000 - RESERVE_FEE_BPS) - 1) / (10000 - RESERVE_FEE_BPS);
+    }
 
-        return extended_asset(out * ((double) pow10(to_symbol.precision()) / pow10(from.symbol.precision())), to_symbol);
+    // like a maker, a reserve is owed the rounded-up amount and pays out the
+    // rounded-down one
+    int64_t reserve_t::pays_for(uint8_t side, int64_t out) const {
+        eosio_assert(out >= 0 && out < holds(side), "reserve can't pay out that much");
+        uint128_t in = reserve_payment(holds(side), takes(side), out);
+        eosio_assert(in <= asset::max_amount, "conversion overflow");
+        return (int64_t) in;
+    }
+
+    int64_t reserve_t::paid_by(uint8_t side, int64_t in) const {
+        eosio_assert(in >= 0, "invalid conversion");
+        uint128_t kept = (uint128_t) in * (10000 - RESERVE_FEE_BPS) / 10000;
+        return (int64_t) ((uint128_t) holds(side) * kept / (takes(side) + kept));
+    }
+
+    uint128_t reserve_t::price(const pair_t& pair, uint8_t side) const {
+        int64_t exponent = PRICE_PRECISION + (int64_t) pair.base_symbol.precision() - (int64_t) pair.quote_symbol.precision();
+        if (side == ask) {
+            return scaled_div((uint128_t) quote * 10000, exponent, (uint128_t) base * (10000 - RESERVE_FEE_BPS), true);
+        }
+        return scaled_div((uint128_t) quote * (10000 - RESERVE_FEE_BPS), exponent, (uint128_t) base * 10000, false);
+    }
+
+    int64_t reserve_t::available(const pair_t& pair, uint8_t side, int64_t most, uint64_t bound) const {
+        int64_t limit = std::min(most, holds(side) - 1);
+        if (limit <= 0) return 0;
+        if (bound == 0) return limit;
+
+        // the price only worsens as the reserve pays out, so the payouts
+        // within bound are a prefix and a bisection finds its end
+        auto within = [&](int64_t out) {
+            uint128_t in = reserve_payment(holds(side), takes(side), out);
+            if (in > asset::max_amount) return false;
+            auto p = traded(side, out, (int64_t) in).price(pair, side);
+            return side == ask ? p <= bound : p >= bound;
+        };
+        if (within(limit)) return limit;
+        if (!within(0)) return 0;
+
+        int64_t low = 0;
+        int64_t high = limit;
+        while (high - low > 1) {
+            int64_t middle = low + (high - low) / 2;
+            if (within(middle)) {
+                low = middle;
+            } else {
+                high = middle;
+            }
+        }
+        return low;
+    }
+
+    reserve_t reserve_t::traded(uint8_t side, int64_t out, int64_t in) const {
+        auto after = *this;
+        if (side == ask) {
+            after.base -= out;
+            after.quote += in;
+        } else {
+            after.quote -= out;
+            after.base += in;
+        }
+        return after;
     }
 
+#ifdef EXCHANGE_TRACE
     void exchange_state::print() const {
         eosio::print(
                 name{manager}, ' ',
-                base, "->",
-                quote_symbol, ' ',
+                amount, ' ',
                 get_price(), ' ',
-                get_rprice(), ' ',
                 primary_key()
         );
     }
+#endif
 
 } /// namespace eosio
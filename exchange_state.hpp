@@ -1,7 +1,9 @@
 #pragma once
 
 #include <eosiolib/asset.hpp>
+#include <eosiolib/singleton.hpp>
 #include "pow10.h"
+#include "trace.h"
 
 namespace eosio {
 
@@ -12,35 +14,462 @@ namespace eosio {
 
         uint64_t primary_key() const { return id; }
 
+        uint128_t get_symbols() const { return symbols_key(base_symbol, quote_symbol); }
+
+        bool trades(symbol_type a, symbol_type b) const {
+            return (a == base_symbol && b == quote_symbol) || (a == quote_symbol && b == base_symbol);
+        }
+
+        static uint128_t symbols_key(symbol_type base_symbol, symbol_type quote_symbol) {
+            return ((uint128_t) base_symbol.value << 64) | quote_symbol.value;
+        }
+
         EOSLIB_SERIALIZE(pair_t, (id)(base_symbol)(quote_symbol))
     };
 
-    typedef multi_index<N(pairs), pair_t> pairs_table;
+    typedef multi_index<N(pairs), pair_t,
+            indexed_by<N(bysymbols), const_mem_fun < pair_t, uint128_t, &pair_t::get_symbols> >
+    > pairs_table;
+
+    // layout of `pairs` before the bysymbols index was introduced
+    typedef multi_index<N(pairs), pair_t> legacy_pairs_table;
+
+    // version of the table layouts, bumped by the `migrate` action
+    struct schema_t {
+        uint64_t version;
+
+        EOSLIB_SERIALIZE(schema_t, (version))
+    };
+
+    typedef singleton<N(schema), schema_t> schema_singleton;
+
+    static const uint64_t SCHEMA_VERSION = 8;
+
+    // progress of a paginated cleanstate, removed once every table is empty
+    struct cleanup_t {
+        uint64_t pair_id;
+        uint64_t erased;
+
+        EOSLIB_SERIALIZE(cleanup_t, (pair_id)(erased))
+    };
+
+    typedef singleton<N(cleanup), cleanup_t> cleanup_singleton;
+
+    // progress of a paginated migrate in the step after the schema's
+    // version, removed once the tables are up to date. phase counts the
+    // passes of a step that makes several; pair_id and id are the next row
+    // to read
+    struct migration_t {
+        uint8_t phase;
+        uint64_t pair_id;
+        uint64_t id;
+
+        EOSLIB_SERIALIZE(migration_t, (phase)(pair_id)(id))
+    };
+
+    typedef singleton<N(migration), migration_t> migration_singleton;
+
+    // the number the next book event gets, see events.hpp; cleanstate
+    // keeps it so numbers never repeat
+    struct event_sequence_t {
+        uint64_t next;
 
+        EOSLIB_SERIALIZE(event_sequence_t, (next))
+    };
+
+    typedef singleton<N(eventseq), event_sequence_t> event_sequence_singleton;
+
+    // prices are quote per base in display units, fixed-point with PRICE_PRECISION decimals
+#define PRICE_PRECISION 8
+
+    static const uint64_t PRICE_SCALE = POW10(PRICE_PRECISION);
+
+    // which token a resting order holds: asks sell the pair's base, bids
+    // sell its quote; both sides of a pair share one book
+    enum order_side : uint8_t {
+        ask = 0,
+        bid = 1
+    };
+
+    // a resting order; the table is scoped by pair id, so the symbols come
+    // from the pair and only the amount of the token the order sells is
+    // stored. Prices are always the pair's quote per base. An expiration of
+    // 0 means the order rests until it is filled or cancelled; an order
+    // that expires is listed in `expiring` as well.
+    //
+    // A ladder is one row for evenly spaced orders: amount and price are its
+    // best level, and `levels` more of `size` each follow `step` apart, away
+    // from the other side. Only the best level is in the byprice index; the
+    // next one takes its place when it empties.
+    //
+    // A row ends after the last field its order uses: a plain order at
+    // price, an expiring one at expiration and a ladder at size
     struct exchange_state {
         uint64_t id;
         account_name manager;
-        asset base;
-        symbol_type quote_symbol;
-        double price;
+        uint8_t side;
+        int64_t amount;
+        uint64_t price;
+        uint32_t expiration;
+        uint64_t step;
+        uint16_t levels;
+        int64_t size;
 
         uint64_t primary_key() const { return id; }
 
         account_name get_manager() const { return manager; };
 
-        double get_price() const { return price; }
+        uint64_t get_price() const { return price; }
+
+        uint128_t get_priority() const { return priority_key(side, price, id); }
+
+        uint128_t get_manager_price() const { return manager_key(manager, price); }
+
+        bool is_expired(uint32_t time) const { return expiration && expiration <= time; }
+
+        // the token the order sells and holds in escrow
+        symbol_type get_symbol(const pair_t& pair) const { return side == ask ? pair.base_symbol : pair.quote_symbol; }
+
+        asset get_amount(const pair_t& pair) const { return asset(amount, get_symbol(pair)); }
+
+        // the escrow of every level the order has left
+        int64_t total() const { return amount + levels * size; }
+
+        // the order once its best level is gone
+        exchange_state next_level() const;
 
-        double get_rprice() const { return 1 / price; }
+        // pays out `out` from the best levels on; false once nothing is left
+        bool take(int64_t out);
 
-        extended_asset convert(extended_asset from, extended_symbol to_symbol) const;
+        // matching priority: asks from the lowest price, bids from the
+        // highest, then the oldest order. The side is the top bit, so each
+        // side is one contiguous range of byprice; ids stay below 2^63
+        static uint128_t priority_key(uint8_t side, uint64_t price, uint64_t id) {
+            uint64_t rank = side == ask ? price : UINT64_MAX - price;
+            return ((uint128_t) side << 127) | ((uint128_t) rank << 63) | id;
+        }
 
+        static uint128_t manager_key(account_name manager, uint64_t price) {
+            return ((uint128_t) manager << 64) | price;
+        }
+
+        // the taker's token owed for `out` of the order's token, rounded up
+        int64_t pays_for(const pair_t& pair, int64_t out) const;
+
+        // the order's token paid out for `in` of the taker's token, rounded down
+        int64_t paid_by(const pair_t& pair, int64_t in) const;
+
+        static uint64_t price_of(const asset& base, const asset& quote, bool round_up);
+
+#ifdef EXCHANGE_TRACE
         void print() const;
+#endif
+
+        template<typename DataStream>
+        friend DataStream& operator<<(DataStream& ds, const exchange_state& t) {
+            ds << t.id << t.manager << t.side << t.amount << t.price;
+            if (t.expiration || t.levels) ds << t.expiration;
+            if (t.levels) ds << t.step << t.levels << t.size;
+            return ds;
+        }
 
-        EOSLIB_SERIALIZE(exchange_state, (id)(manager)(base)(quote_symbol)(price))
+        template<typename DataStream>
+        friend DataStream& operator>>(DataStream& ds, exchange_state& t) {
+            ds >> t.id >> t.manager >> t.side >> t.amount >> t.price;
+            t.expiration = 0;
+            t.step = 0;
+            t.levels = 0;
+            t.size = 0;
+            if (ds.remaining()) ds >> t.expiration;
+            if (ds.remaining()) ds >> t.step >> t.levels >> t.size;
+            return ds;
+        }
     };
 
+    // rows sharing a bymanager key are ordered by id
     typedef eosio::multi_index<N(markets), exchange_state,
-            indexed_by<N(byprice), const_mem_fun < exchange_state, double, &exchange_state::get_price> >
+            indexed_by<N(byprice), const_mem_fun < exchange_state, uint128_t, &exchange_state::get_priority> >,
+            indexed_by<N(bymanager), const_mem_fun < exchange_state, uint128_t, &exchange_state::get_manager_price> >
     > markets_table;
 
+    // index number `markets` had its byexpiry index at, before expirations
+    // moved to `expiring`
+    static const uint64_t LEGACY_EXPIRY_INDEX = 2;
+
+    // an order of the pair's book that expires, scoped by pair id, so
+    // orders that never expire carry no expiry index entry. Keyed by order
+    // id; byexpiry lists the soonest expiration first, then by id
+    struct expiring_order {
+        uint64_t id;
+        uint32_t expiration;
+
+        uint64_t primary_key() const { return id; }
+        uint128_t get_expiry() const { return expiry_key(expiration, id); }
+
+        static uint128_t expiry_key(uint32_t expiration, uint64_t id) {
+            return ((uint128_t) expiration << 64) | id;
+        }
+
+        EOSLIB_SERIALIZE(expiring_order, (id)(expiration))
+    };
+
+    typedef eosio::multi_index<N(expiring), expiring_order,
+            indexed_by<N(byexpiry), const_mem_fun < expiring_order, uint128_t, &expiring_order::get_expiry> >
+    > expiring_table;
+
+    // levels a single ladder may hold
+    static const uint16_t MAX_LADDER_LEVELS = 100;
+
+    // expired orders one action's match loops refund and erase as they meet them
+    static const uint16_t PURGE_BUDGET = 8;
+
+    // a limit.trade queued for the pair's next batch auction, scoped by pair
+    // id; like a resting order it holds what it sells and is limited at price
+    struct pending_order {
+        uint64_t id;
+        account_name owner;
+        uint8_t side;
+        int64_t amount;
+        uint64_t price;
+
+        uint64_t primary_key() const { return id; }
+
+        EOSLIB_SERIALIZE(pending_order, (id)(owner)(side)(amount)(price))
+    };
+
+    typedef eosio::multi_index<N(pending), pending_order> pending_table;
+
+    // what a reserve keeps of every amount a taker pays into it, in
+    // hundredths of a percent; it is the providers' earnings
+    static const int64_t RESERVE_FEE_BPS = 30;
+
+    // a pair's constant-product reserve, scoped by the contract and keyed by
+    // pair id. The contract holds base and quote itself; takers trade
+    // against them at base * quote = k, with the fee left in, so k only
+    // grows. shares count the providers' claims on both, see liquidity_t.
+    //
+    // On a side the reserve acts like a resting order of that side: as an
+    // ask it pays out base for quote, as a bid quote for base
+    struct reserve_t {
+        uint64_t pair_id;
+        int64_t base;
+        int64_t quote;
+        int64_t shares;
+
+        uint64_t primary_key() const { return pair_id; }
+
+        bool empty() const { return shares == 0 || base == 0 || quote == 0; }
+
+        // what the reserve holds and pays out on side, and what it takes in
+        int64_t holds(uint8_t side) const { return side == ask ? base : quote; }
+
+        int64_t takes(uint8_t side) const { return side == ask ? quote : base; }
+
+        // the taker's token owed for `out` of what side holds, fee included,
+        // rounded up; out must be less than holds(side)
+        int64_t pays_for(uint8_t side, int64_t out) const;
+
+        // what side holds paid out for `in` of the taker's token, rounded down
+        int64_t paid_by(uint8_t side, int64_t in) const;
+
+        // the quote per base the next unit on side trades at, fee included:
+        // rounded up for asks, down for bids
+        uint128_t price(const pair_t& pair, uint8_t side) const;
+
+        // the largest payout up to `most` that leaves the reserve's price on
+        // side at bound or better (0 for no bound)
+        int64_t available(const pair_t& pair, uint8_t side, int64_t most, uint64_t bound) const;
+
+        // the reserve after paying out `out` on side for `in`
+        reserve_t traded(uint8_t side, int64_t out, int64_t in) const;
+
+        EOSLIB_SERIALIZE(reserve_t, (pair_id)(base)(quote)(shares))
+    };
+
+    typedef eosio::multi_index<N(reserves), reserve_t> reserves_table;
+
+    // one provider's shares of a pair's reserve, scoped by pair id; the
+    // provider pays for the row
+    struct liquidity_t {
+        account_name owner;
+        int64_t shares;
+
+        uint64_t primary_key() const { return owner; }
+
+        EOSLIB_SERIALIZE(liquidity_t, (owner)(shares))
+    };
+
+    typedef eosio::multi_index<N(liquidity), liquidity_t> liquidity_table;
+
+    // layout of `markets` rows before both sides of a pair shared one book;
+    // every row was an ask of its own pair. Rows stored before orders could
+    // expire end at price and read as orders that never expire
+    struct one_sided_exchange_state {
+        uint64_t id;
+        account_name manager;
+        int64_t amount;
+        uint64_t price;
+        uint32_t expiration;
+
+        uint64_t primary_key() const { return id; }
+
+        uint128_t get_priority() const { return priority_key(price, id); }
+
+        uint128_t get_manager_price() const { return exchange_state::manager_key(manager, price); }
+
+        uint64_t get_expiry() const { return expiration ? expiration : UINT64_MAX; }
+
+        static uint128_t priority_key(uint64_t price, uint64_t id) {
+            return ((uint128_t) price << 64) | id;
+        }
+
+        template<typename DataStream>
+        friend DataStream& operator<<(DataStream& ds, const one_sided_exchange_state& t) {
+            return ds << t.id << t.manager << t.amount << t.price << t.expiration;
+        }
+
+        template<typename DataStream>
+        friend DataStream& operator>>(DataStream& ds, one_sided_exchange_state& t) {
+            ds >> t.id >> t.manager >> t.amount >> t.price;
+            t.expiration = 0;
+            if (ds.remaining()) ds >> t.expiration;
+            return ds;
+        }
+    };
+
+    typedef eosio::multi_index<N(markets), one_sided_exchange_state,
+            indexed_by<N(byprice), const_mem_fun < one_sided_exchange_state, uint128_t, &one_sided_exchange_state::get_priority> >,
+            indexed_by<N(bymanager), const_mem_fun < one_sided_exchange_state, uint128_t, &one_sided_exchange_state::get_manager_price> >,
+            indexed_by<N(byexpiry), const_mem_fun < one_sided_exchange_state, uint64_t, &one_sided_exchange_state::get_expiry> >
+    > one_sided_markets_table;
+
+    // layout of `markets` rows before orders could expire
+    struct perpetual_exchange_state {
+        uint64_t id;
+        account_name manager;
+        int64_t amount;
+        uint64_t price;
+
+        uint64_t primary_key() const { return id; }
+
+        uint128_t get_priority() const { return one_sided_exchange_state::priority_key(price, id); }
+
+        uint128_t get_manager_price() const { return exchange_state::manager_key(manager, price); }
+
+        EOSLIB_SERIALIZE(perpetual_exchange_state, (id)(manager)(amount)(price))
+    };
+
+    typedef eosio::multi_index<N(markets), perpetual_exchange_state,
+            indexed_by<N(byprice), const_mem_fun < perpetual_exchange_state, uint128_t, &perpetual_exchange_state::get_priority> >,
+            indexed_by<N(bymanager), const_mem_fun < perpetual_exchange_state, uint128_t, &perpetual_exchange_state::get_manager_price> >
+    > perpetual_markets_table;
+
+    // layout of `markets` rows before they were compacted, with both symbols stored per row
+    struct wide_exchange_state {
+        uint64_t id;
+        account_name manager;
+        asset base;
+        symbol_type quote_symbol;
+        uint64_t price;
+
+        uint64_t primary_key() const { return id; }
+
+        uint64_t get_price() const { return price; }
+
+        uint128_t get_priority() const { return one_sided_exchange_state::priority_key(price, id); }
+
+        uint128_t get_manager_price() const { return exchange_state::manager_key(manager, price); }
+
+        EOSLIB_SERIALIZE(wide_exchange_state, (id)(manager)(base)(quote_symbol)(price))
+    };
+
+    typedef eosio::multi_index<N(markets), wide_exchange_state,
+            indexed_by<N(byprice), const_mem_fun < wide_exchange_state, uint128_t, &wide_exchange_state::get_priority> >,
+            indexed_by<N(bymanager), const_mem_fun < wide_exchange_state, uint128_t, &wide_exchange_state::get_manager_price> >
+    > wide_markets_table;
+
+    // layout of `markets` before the (price, id) priority key and the bymanager index
+    typedef eosio::multi_index<N(markets), wide_exchange_state,
+            indexed_by<N(byprice), const_mem_fun < wide_exchange_state, uint64_t, &wide_exchange_state::get_price> >
+    > priced_markets_table;
+
+    // layout of `markets` rows before prices became fixed-point
+    struct legacy_exchange_state {
+        uint64_t id;
+        account_name manager;
+        asset base;
+        symbol_type quote_symbol;
+        double price;
+
+        uint64_t primary_key() const { return id; }
+
+        double get_price() const { return price; }
+
+        EOSLIB_SERIALIZE(legacy_exchange_state, (id)(manager)(base)(quote_symbol)(price))
+    };
+
+    typedef eosio::multi_index<N(markets), legacy_exchange_state,
+            indexed_by<N(byprice), const_mem_fun < legacy_exchange_state, double, &legacy_exchange_state::get_price> >
+    > legacy_markets_table;
+
+    // what every order at one price holds: base for asks, quote for bids
+    struct price_level {
+        uint64_t price;
+        int64_t amount;
+
+        EOSLIB_SERIALIZE(price_level, (price)(amount))
+    };
+
+    static const uint64_t TICKER_DEPTH = 10;
+
+    // summary of one pair's book, kept current by every action that changes
+    // it so a market view is a single row read; each side lists its best
+    // TICKER_DEPTH levels, volumes count since the row was created and a
+    // best price is 0 while its side is empty
+    struct ticker_t {
+        uint64_t pair_id;
+        uint64_t best_ask;
+        vector<price_level> asks;
+        uint64_t best_bid;
+        vector<price_level> bids;
+        uint64_t last_price;
+        int64_t base_volume;
+        int64_t quote_volume;
+
+        uint64_t primary_key() const { return pair_id; }
+
+        EOSLIB_SERIALIZE(ticker_t, (pair_id)(best_ask)(asks)(best_bid)(bids)(last_price)(base_volume)(quote_volume))
+    };
+
+    typedef eosio::multi_index<N(tickers), ticker_t> tickers_table;
+
+    // layout of `tickers` rows before pairs had a bid side
+    struct one_sided_ticker_t {
+        uint64_t pair_id;
+        uint64_t best_price;
+        vector<price_level> levels;
+        uint64_t last_price;
+        int64_t base_volume;
+        int64_t quote_volume;
+
+        uint64_t primary_key() const { return pair_id; }
+
+        EOSLIB_SERIALIZE(one_sided_ticker_t, (pair_id)(best_price)(levels)(last_price)(base_volume)(quote_volume))
+    };
+
+    typedef eosio::multi_index<N(tickers), one_sided_ticker_t> one_sided_tickers_table;
+
+    // funds an account deposited into the exchange, scoped by account;
+    // `reserved` backs the account's resting orders
+    struct balance_t {
+        extended_asset balance;
+        int64_t reserved;
+
+        uint64_t primary_key() const { return balance.symbol.name(); }
+
+        EOSLIB_SERIALIZE(balance_t, (balance)(reserved))
+    };
+
+    typedef eosio::multi_index<N(balances), balance_t> balances_table;
+
 } /// namespace eosio
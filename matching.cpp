@@ -0,0 +1,172 @@
+#include "matching.hpp"
+
+#include <algorithm>
+
+namespace eosio {
+
+    fill_t fill_receiving(const pair_t& pair, const exchange_state& order, int64_t wanted) {
+        int64_t out = std::min(order.amount, wanted);
+        return fill_t{order.id, order.manager, order.price, out, order.pays_for(pair, out), out == order.amount, false};
+    }
+
+    fill_t fill_selling(const pair_t& pair, const exchange_state& order, int64_t remaining) {
+        int64_t in = order.pays_for(pair, order.amount);
+        if (in <= remaining) {
+            return fill_t{order.id, order.manager, order.price, order.amount, in, true, false};
+        }
+        return fill_t{order.id, order.manager, order.price, order.paid_by(pair, remaining), remaining, false, false};
+    }
+
+    // a reserve fill of out for in, priced at its average quote per base;
+    // none when rounding puts that average past bound, which only a few
+    // units can suffer
+    fill_t reserve_fill(const pair_t& pair, uint8_t side, int64_t out, int64_t in, uint64_t bound) {
+        fill_t none{pair.id, 0, 0, 0, 0, false, true};
+        if (out == 0 || in == 0) return none;
+
+        int64_t base = side == ask ? out : in;
+        int64_t quote = side == ask ? in : out;
+        int64_t exponent = PRICE_PRECISION + (int64_t) pair.base_symbol.precision() - (int64_t) pair.quote_symbol.precision();
+        uint128_t price = scaled_div(quote, exponent, base, side == ask);
+        if (bound && (side == ask ? price > bound : price < bound)) return none;
+
+        return fill_t{pair.id, 0, (uint64_t) std::min<uint128_t>(std::max<uint128_t>(price, 1), UINT64_MAX),
+                      out, in, false, true};
+    }
+
+    fill_t reserve_receiving(const pair_t& pair, const reserve_t& reserve, uint8_t side, int64_t wanted, uint64_t bound) {
+        int64_t out = reserve.available(pair, side, wanted, bound);
+        return reserve_fill(pair, side, out, reserve.pays_for(side, out), bound);
+    }
+
+    fill_t reserve_selling(const pair_t& pair, const reserve_t& reserve, uint8_t side, int64_t remaining, uint64_t bound) {
+        // all of remaining when the bound allows what it buys, so the last
+        // fill of a sell uses up the taker's amount exactly
+        int64_t most = reserve.paid_by(side, remaining);
+        int64_t out = reserve.available(pair, side, most, bound);
+        if (out == 0) return reserve_fill(pair, side, 0, 0, bound);
+        return reserve_fill(pair, side, out, out == most ? remaining : reserve.pays_for(side, out), bound);
+    }
+
+    // walks one side of the book from its best order until the taker has
+    // sold or received goal; take(order, result) returns the fill the order
+    // makes given what is matched so far. A ladder's next level joins the
+    // walk at its own price once the one before it is used up.
+    //
+    // Before each order, take_reserve(pool, bound, result) fills from the
+    // reserve while it prices at the order's price or better, and once the
+    // book runs out or passes the limit, up to the limit
+    template<typename Take, typename TakeReserve>
+    void walk(const markets_table& markets, const reserve_t* reserve, account_name seller, const asset& goal,
+              uint64_t limit_price, uint16_t max_fills, uint32_t time, quote_t& result,
+              Take&& take, TakeReserve&& take_reserve) {
+        auto side = result.side;
+        auto sorted_markets = markets.get_index<N(byprice)>();
+        auto first = exchange_state::priority_key(side, side == ask ? 0 : UINT64_MAX, 0);
+        auto row = sorted_markets.lower_bound(first);
+        // ladder levels not in the index yet, the best last
+        vector<exchange_state> deeper;
+        // the reserve as the fills so far leave it
+        reserve_t pool = reserve ? *reserve : reserve_t{};
+        // true once the goal is met
+        auto from_reserve = [&](uint64_t bound) {
+            if (pool.empty()) return false;
+            auto fill = take_reserve(pool, bound, result);
+            if (fill.out == 0) return false;
+            pool = pool.traded(side, fill.out, fill.in);
+            result.sold.amount += fill.in;
+            result.received.amount += fill.out;
+            result.fills.push_back(fill);
+            return (goal.symbol == result.sold.symbol ? result.sold : result.received) == goal;
+        };
+        // the goal is met or max_fills stopped the walk
+        bool done = false;
+        while (true) {
+            bool from_row = row != sorted_markets.end() && row->side == side;
+            bool from_deeper = !deeper.empty() && (!from_row || deeper.back().get_priority() < row->get_priority());
+            if (!from_row && !from_deeper) break;
+            auto order = from_deeper ? deeper.back() : *row;
+            if (!from_deeper) TRACE_COUNT(rows_visited, 1);
+
+            if (limit_price && (side == ask ? order.price > limit_price : order.price < limit_price)) break;
+            if (max_fills && result.fills.size() == max_fills) {
+                result.bounded = true;
+                done = true;
+                break;
+            }
+            if (from_deeper) {
+                deeper.pop_back();
+            } else {
+                row++;
+                // never fill against the seller's own order; the row is read
+                // for its price anyway, so its manager costs nothing more
+                if (order.manager == seller) {
+                    TRACE_COUNT(own_skipped, 1);
+                    continue;
+                }
+                if (order.is_expired(time)) {
+                    result.expired.push_back(order.id);
+                    continue;
+                }
+            }
+            if (from_reserve(order.price)) {
+                done = true;
+                break;
+            }
+            if (max_fills && result.fills.size() == max_fills) {
+                result.bounded = true;
+                done = true;
+                break;
+            }
+            auto fill = take(order, result);
+            result.sold.amount += fill.in;
+            result.received.amount += fill.out;
+            result.fills.push_back(fill);
+
+            if ((goal.symbol == result.sold.symbol ? result.sold : result.received) == goal) {
+                done = true;
+                break;
+            }
+            if (fill.exhausts && order.levels > 0) {
+                auto next = order.next_level();
+                auto at = std::upper_bound(deeper.begin(), deeper.end(), next, [](const exchange_state& a, const exchange_state& b) {
+                    return a.get_priority() > b.get_priority();
+                });
+                deeper.insert(at, next);
+            }
+        }
+        if (!done && (!max_fills || result.fills.size() < max_fills)) {
+            from_reserve(limit_price);
+        }
+    }
+
+    quote_t quote_buy(const markets_table& markets, const reserve_t* reserve, const pair_t& pair, account_name seller,
+                      const asset& receive, uint16_t max_fills, uint32_t time) {
+        // the side holding what the taker buys
+        uint8_t side = receive.symbol == pair.base_symbol ? ask : bid;
+        quote_t result{side, asset(0, side == ask ? pair.quote_symbol : pair.base_symbol), asset(0, receive.symbol), {}, {}, false};
+        if (receive.amount == 0) return result;
+
+        walk(markets, reserve, seller, receive, 0, max_fills, time, result, [&](const exchange_state& order, const quote_t& so_far) {
+            return fill_receiving(pair, order, receive.amount - so_far.received.amount);
+        }, [&](const reserve_t& pool, uint64_t bound, const quote_t& so_far) {
+            return reserve_receiving(pair, pool, side, receive.amount - so_far.received.amount, bound);
+        });
+        return result;
+    }
+
+    quote_t quote_sell(const markets_table& markets, const reserve_t* reserve, const pair_t& pair, account_name seller,
+                       const asset& sell, uint64_t limit_price, uint16_t max_fills, uint32_t time) {
+        // the side wanting what the taker sells
+        uint8_t side = sell.symbol == pair.quote_symbol ? ask : bid;
+        quote_t result{side, asset(0, sell.symbol), asset(0, side == ask ? pair.base_symbol : pair.quote_symbol), {}, {}, false};
+        if (sell.amount == 0) return result;
+
+        walk(markets, reserve, seller, sell, limit_price, max_fills, time, result, [&](const exchange_state& order, const quote_t& so_far) {
+            return fill_selling(pair, order, sell.amount - so_far.sold.amount);
+        }, [&](const reserve_t& pool, uint64_t bound, const quote_t& so_far) {
+            return reserve_selling(pair, pool, side, sell.amount - so_far.sold.amount, bound);
+        });
+        return result;
+    }
+} // namespace eosio
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <eosiolib/eosio.hpp>
+#include <eosiolib/asset.hpp>
+#include "exchange_state.hpp"
+
+namespace eosio {
+
+    // One resting order a taking order would match: the order pays out
+    // `out` of the token it holds for `in` of the taker's token at its
+    // price, and is erased when exhausted. Each level of a ladder fills
+    // separately under the ladder's id. A fill from the pair's reserve has
+    // no maker, the pair's id and the average price it trades at.
+    struct fill_t {
+        uint64_t id;
+        account_name maker;
+        uint64_t price;
+        int64_t out;
+        int64_t in;
+        bool exhausts;
+        bool from_reserve;
+    };
+
+    // What a taking order would do against one side of a book and the
+    // pair's reserve. The match loops execute exactly this, so a quote read
+    // without writing is what a trade yields.
+    struct quote_t {
+        uint8_t side;
+        asset sold;
+        asset received;
+        vector<fill_t> fills;
+        // expired orders stepped over on the way, in matching order
+        vector<uint64_t> expired;
+        // stopped by max_fills while orders within the limit were left
+        bool bounded;
+    };
+
+    // the fill of order when the taker still wants `wanted` of its token
+    fill_t fill_receiving(const pair_t& pair, const exchange_state& order, int64_t wanted);
+
+    // the fill of order when the taker still sells `remaining` of its own
+    // token: the whole order if that covers it, otherwise what remaining
+    // buys at the order's price, rounded down
+    fill_t fill_selling(const pair_t& pair, const exchange_state& order, int64_t remaining);
+
+    // the reserve's fill when the taker still wants `wanted` of the token
+    // side holds, as far as its price stays at bound or better (0 for none)
+    fill_t reserve_receiving(const pair_t& pair, const reserve_t& reserve, uint8_t side, int64_t wanted, uint64_t bound);
+
+    // the reserve's fill when the taker still sells `remaining`, as far as
+    // its price stays at bound or better (0 for none)
+    fill_t reserve_selling(const pair_t& pair, const reserve_t& reserve, uint8_t side, int64_t remaining, uint64_t bound);
+
+    // buy receive from the side holding it, paying as little as the book
+    // asks; reserve is the pair's, or nullptr to match the book alone
+    quote_t quote_buy(const markets_table& markets, const reserve_t* reserve, const pair_t& pair, account_name seller,
+                      const asset& receive, uint16_t max_fills, uint32_t time);
+
+    // sell sell to the side wanting it for as much as the book pays, at
+    // limit_price or better (0 for no limit): at most limit_price quote per
+    // base when selling quote, at least that much when selling base
+    quote_t quote_sell(const markets_table& markets, const reserve_t* reserve, const pair_t& pair, account_name seller,
+                       const asset& sell, uint64_t limit_price, uint16_t max_fills, uint32_t time);
+} // namespace eosio
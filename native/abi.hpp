@@ -0,0 +1,282 @@
+#pragma once
+
+// Turns action data written as JSON, the way nodeos prints it, into the
+// packed bytes `apply` reads, following the contract's ABI. The reader is
+// lenient about commas, which the hand-edited build/exchange.abi needs.
+
+#include <eosiolib/eosio.hpp>
+#include <eosiolib/asset.hpp>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace eosio {
+    namespace native {
+
+        struct json {
+            enum kind_t : uint8_t { null, boolean, number, string, array, object };
+
+            kind_t kind = null;
+            // the digits of a number, the contents of a string, "true" or "false"
+            std::string text;
+            std::vector<json> items;
+            std::vector<std::pair<std::string, json>> fields;
+
+            const json* find(const std::string& key) const {
+                for (const auto& f : fields) {
+                    if (f.first == key) return &f.second;
+                }
+                return nullptr;
+            }
+
+            const json& at(const std::string& key) const {
+                auto value = find(key);
+                if (!value) throw std::runtime_error("missing field " + key);
+                return *value;
+            }
+
+            static json parse(const std::string& text) {
+                size_t pos = 0;
+                auto value = _parse(text, pos);
+                _skip(text, pos);
+                if (pos != text.size()) throw std::runtime_error("trailing characters in JSON");
+                return value;
+            }
+
+        private:
+            // commas separate nothing the brackets don't already, so they
+            // count as whitespace; missing and trailing ones are both fine
+            static void _skip(const std::string& text, size_t& pos) {
+                while (pos < text.size() && (isspace((unsigned char) text[pos]) || text[pos] == ',')) pos++;
+            }
+
+            static void _expect(const std::string& text, size_t& pos, char c) {
+                _skip(text, pos);
+                if (pos >= text.size() || text[pos] != c) {
+                    throw std::runtime_error(std::string("expected '") + c + "' in JSON at " + std::to_string(pos));
+                }
+                pos++;
+            }
+
+            static std::string _string(const std::string& text, size_t& pos) {
+                _expect(text, pos, '"');
+                std::string result;
+                while (pos < text.size() && text[pos] != '"') {
+                    char c = text[pos++];
+                    if (c != '\\') {
+                        result += c;
+                        continue;
+                    }
+                    if (pos >= text.size()) break;
+                    c = text[pos++];
+                    switch (c) {
+                        case 'n': result += '\n'; break;
+                        case 't': result += '\t'; break;
+                        case 'r': result += '\r'; break;
+                        case 'b': result += '\b'; break;
+                        case 'f': result += '\f'; break;
+                        case 'u': {
+                            // names, symbols and amounts are ASCII, so only the BMP is decoded
+                            if (pos + 4 > text.size()) throw std::runtime_error("bad escape in JSON");
+                            auto code = (uint32_t) std::stoul(text.substr(pos, 4), nullptr, 16);
+                            pos += 4;
+                            if (code < 0x80) {
+                                result += (char) code;
+                            } else if (code < 0x800) {
+                                result += (char) (0xc0 | code >> 6);
+                                result += (char) (0x80 | (code & 0x3f));
+                            } else {
+                                result += (char) (0xe0 | code >> 12);
+                                result += (char) (0x80 | (code >> 6 & 0x3f));
+                                result += (char) (0x80 | (code & 0x3f));
+                            }
+                            break;
+                        }
+                        default: result += c;
+                    }
+                }
+                _expect(text, pos, '"');
+                return result;
+            }
+
+            static json _parse(const std::string& text, size_t& pos) {
+                _skip(text, pos);
+                if (pos >= text.size()) throw std::runtime_error("unexpected end of JSON");
+
+                json value;
+                char c = text[pos];
+                if (c == '{') {
+                    value.kind = object;
+                    pos++;
+                    for (_skip(text, pos); pos < text.size() && text[pos] != '}'; _skip(text, pos)) {
+                        auto key = _string(text, pos);
+                        _expect(text, pos, ':');
+                        value.fields.emplace_back(key, _parse(text, pos));
+                    }
+                    _expect(text, pos, '}');
+                } else if (c == '[') {
+                    value.kind = array;
+                    pos++;
+                    for (_skip(text, pos); pos < text.size() && text[pos] != ']'; _skip(text, pos)) {
+                        value.items.push_back(_parse(text, pos));
+                    }
+                    _expect(text, pos, ']');
+                } else if (c == '"') {
+                    value.kind = string;
+                    value.text = _string(text, pos);
+                } else if (text.compare(pos, 4, "true") == 0 || text.compare(pos, 5, "false") == 0) {
+                    value.kind = boolean;
+                    value.text = c == 't' ? "true" : "false";
+                    pos += value.text.size();
+                } else if (text.compare(pos, 4, "null") == 0) {
+                    pos += 4;
+                } else {
+                    value.kind = number;
+                    while (pos < text.size() && (isdigit((unsigned char) text[pos]) || strchr("+-.eE", text[pos]))) {
+                        value.text += text[pos++];
+                    }
+                    if (value.text.empty()) throw std::runtime_error("unexpected character in JSON at " + std::to_string(pos));
+                }
+                return value;
+            }
+        };
+
+        inline std::string read_file(const std::string& path) {
+            std::ifstream file(path, std::ios::binary);
+            if (!file) throw std::runtime_error("can't open " + path);
+            return std::string((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        }
+
+        inline std::vector<char> from_hex(const std::string& hex) {
+            if (hex.size() % 2) throw std::runtime_error("odd length hex " + hex);
+            std::vector<char> bytes;
+            for (size_t i = 0; i < hex.size(); i += 2) {
+                bytes.push_back((char) std::stoul(hex.substr(i, 2), nullptr, 16));
+            }
+            return bytes;
+        }
+
+        // the structs and actions of an ABI, enough to encode action data
+        class abi {
+        public:
+            explicit abi(const json& definition) {
+                if (auto types = definition.find("types")) {
+                    for (const auto& t : types->items) {
+                        _typedefs[t.at("new_type_name").text] = t.at("type").text;
+                    }
+                }
+                for (const auto& s : definition.at("structs").items) {
+                    auto& def = _structs[s.at("name").text];
+                    if (auto base = s.find("base")) def.base = base->text;
+                    for (const auto& f : s.at("fields").items) {
+                        def.fields.emplace_back(f.at("name").text, f.at("type").text);
+                    }
+                }
+                for (const auto& a : definition.at("actions").items) {
+                    _actions[string_to_name(a.at("name").text.c_str())] = a.at("type").text;
+                }
+            }
+
+            static abi load(const std::string& path) { return abi(json::parse(read_file(path))); }
+
+            bool has_action(action_name act) const { return _actions.count(act) > 0; }
+
+            // the packed data of action act, given as its JSON object
+            std::vector<char> encode_action(action_name act, const json& data) const {
+                auto itr = _actions.find(act);
+                if (itr == _actions.end()) throw std::runtime_error("no action " + name{act}.to_string() + " in the ABI");
+                std::vector<char> out;
+                _encode(itr->second, data, out);
+                return out;
+            }
+
+        private:
+            struct struct_def {
+                std::string base;
+                std::vector<std::pair<std::string, std::string>> fields;
+            };
+
+            std::map<std::string, std::string> _typedefs;
+            std::map<std::string, struct_def> _structs;
+            std::map<action_name, std::string> _actions;
+
+            template<typename T>
+            static void _append(std::vector<char>& out, const T& value) {
+                auto bytes = pack(value);
+                out.insert(out.end(), bytes.begin(), bytes.end());
+            }
+
+            // "4,LTA"
+            static symbol_type _symbol(const std::string& text) {
+                auto comma = text.find(',');
+                if (comma == std::string::npos) throw std::runtime_error("bad symbol " + text);
+                return symbol_type(string_to_symbol((uint8_t) std::stoul(text.substr(0, comma)), text.substr(comma + 1).c_str()));
+            }
+
+            // "1.0000 LTA", its precision the digits after the point
+            static asset _asset(const std::string& text) {
+                auto space = text.find(' ');
+                if (space == std::string::npos) throw std::runtime_error("bad asset " + text);
+                auto amount = text.substr(0, space);
+                auto point = amount.find('.');
+                uint8_t precision = 0;
+                if (point != std::string::npos) {
+                    precision = (uint8_t) (amount.size() - point - 1);
+                    amount.erase(point, 1);
+                }
+                return asset(std::stoll(amount), string_to_symbol(precision, text.substr(space + 1).c_str()));
+            }
+
+            void _encode(std::string type, const json& value, std::vector<char>& out) const {
+                while (_typedefs.count(type)) type = _typedefs.at(type);
+
+                if (type.size() > 2 && type.compare(type.size() - 2, 2, "[]") == 0) {
+                    _append(out, unsigned_int{(uint32_t) value.items.size()});
+                    for (const auto& item : value.items) _encode(type.substr(0, type.size() - 2), item, out);
+                    return;
+                }
+
+                auto def = _structs.find(type);
+                if (def != _structs.end()) {
+                    if (!def->second.base.empty()) _encode(def->second.base, value, out);
+                    for (const auto& f : def->second.fields) {
+                        // a binary extension may be left out, and every field after it with it
+                        bool extension = f.second.back() == '$';
+                        if (extension && !value.find(f.first)) break;
+                        _encode(extension ? f.second.substr(0, f.second.size() - 1) : f.second, value.at(f.first), out);
+                    }
+                    return;
+                }
+
+                const auto& text = value.text;
+                if (type == "name") _append(out, string_to_name(text.c_str()));
+                else if (type == "bool") _append(out, (uint8_t) (text == "true"));
+                else if (type == "uint8") _append(out, (uint8_t) std::stoul(text));
+                else if (type == "uint16") _append(out, (uint16_t) std::stoul(text));
+                else if (type == "uint32") _append(out, (uint32_t) std::stoul(text));
+                else if (type == "uint64") _append(out, (uint64_t) std::stoull(text));
+                else if (type == "int8") _append(out, (int8_t) std::stol(text));
+                else if (type == "int16") _append(out, (int16_t) std::stol(text));
+                else if (type == "int32") _append(out, (int32_t) std::stol(text));
+                else if (type == "int64") _append(out, (int64_t) std::stoll(text));
+                else if (type == "string") _append(out, text);
+                else if (type == "symbol") _append(out, _symbol(text));
+                else if (type == "asset") _append(out, _asset(text));
+                else if (type == "checksum256") {
+                    auto bytes = from_hex(text);
+                    if (bytes.size() != 32) throw std::runtime_error("bad checksum256 " + text);
+                    out.insert(out.end(), bytes.begin(), bytes.end());
+                } else if (type == "extended_asset") {
+                    _append(out, _asset(value.at("quantity").text));
+                    _append(out, string_to_name(value.at("contract").text.c_str()));
+                } else {
+                    throw std::runtime_error("can't encode ABI type " + type);
+                }
+            }
+        };
+
+    } // namespace native
+} // namespace eosio
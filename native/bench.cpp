@@ -0,0 +1,214 @@
+// Matching benchmarks against the native build of the contract.
+//
+// Every case restores the same seeded book before each iteration, then
+// times a single action through `apply` and reports wall time, table
+// operations (row reads, writes and erases) and inline actions sent. The
+// mirror cases time the off-chain book in mirror.hpp on the same rows.
+
+#include "harness.hpp"
+#include "mirror.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <malloc.h>
+
+using namespace eosio;
+using namespace eosio::native;
+
+namespace {
+
+    const account_name self = N(exchange);
+    const symbol_type WU = wu_token::symbol;
+    const symbol_type LTA = S(4, LTA);
+    const symbol_type LTB = S(4, LTB);
+    const account_name taker = N(taker);
+    const account_name quoter = N(quoter);
+
+    const uint64_t MAKERS = 1000;
+
+    const uint16_t LADDER_LEVELS = 20;
+
+    struct book {
+        uint64_t depth;
+        std::map<table_id, table_store> db;
+    };
+
+    int64_t units(symbol_type symbol, int64_t whole) {
+        int64_t result = whole;
+        for (uint64_t i = 0; i < symbol.precision(); i++) result *= 10;
+        return result;
+    }
+
+    // LTA/WU bids 1 WU per order from 2 WU per LTA down, LTB/WU asks 1 LTB per order from 2 WU up
+    book seed(uint64_t depth) {
+        reset();
+        add_loyalty_token(LOYALTY_CONTRACT, LTA);
+        add_loyalty_token(LOYALTY_CONTRACT, LTB);
+        push(self, N(whitemany), std::vector<account_name>{taker, quoter}, {self});
+
+        auto lta_wu = add_pair(self, LTA, WU);
+        auto ltb_wu = add_pair(self, LTB, WU);
+        for (uint64_t i = 0; i < depth; i++) {
+            auto maker = numbered_name("mk", i % MAKERS);
+            add_order(self, lta_wu, maker, bid, units(WU, 1), 200000000 - i * 1000);
+            add_order(self, ltb_wu, maker, ask, units(LTB, 1), 200000000 + i * 10000);
+        }
+        add_ticker(self, lta_wu);
+        add_ticker(self, ltb_wu);
+        return book{depth, ctx().db};
+    }
+
+    template<typename T>
+    void run(const book& b, const char* label, account_name act, const T& data,
+             account_name signer, uint64_t iterations) {
+        uint64_t ns = 0;
+        counters total;
+        outcome last{};
+        for (uint64_t i = 0; i < iterations; i++) {
+            ctx().db = b.db;
+            // hand the previous copy's chunks back now rather than inside the timed call
+            malloc_trim(0);
+            last = push(self, act, data, {signer}, false);
+            if (!last.ok) break;
+            ns += last.ns;
+            total.db_reads += last.stats.db_reads;
+            total.db_writes += last.stats.db_writes;
+            total.db_erases += last.stats.db_erases;
+            total.inline_actions += last.stats.inline_actions;
+        }
+        if (!last.ok) {
+            printf("%-14s %8llu   failed: %s\n", label, (unsigned long long) b.depth, last.error.c_str());
+            return;
+        }
+        printf("%-14s %8llu %12.0f %10.1f %10.1f %10.1f %10.1f\n", label, (unsigned long long) b.depth,
+               (double) ns / iterations,
+               (double) total.db_reads / iterations,
+               (double) (total.db_writes + total.db_erases) / iterations,
+               (double) (total.db_reads + total.db_writes + total.db_erases) / iterations,
+               (double) total.inline_actions / iterations);
+#ifdef EXCHANGE_TRACE
+        // every iteration starts from the same book, so the last one stands for all
+        printf("%-14s %8s %12s visited %llu, written %llu, erased %llu, own skipped %llu, inline %llu\n", "", "", "",
+               (unsigned long long) last.trace.rows_visited,
+               (unsigned long long) last.trace.rows_written,
+               (unsigned long long) last.trace.rows_erased,
+               (unsigned long long) last.trace.own_skipped,
+               (unsigned long long) last.trace.inline_actions);
+#endif
+    }
+
+    template<typename F>
+    void time_mirror(const book& b, const char* label, uint64_t iterations, F&& query) {
+        auto start = std::chrono::steady_clock::now();
+        for (uint64_t i = 0; i < iterations; i++) query();
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        printf("%-14s %8llu %12.0f\n", label, (unsigned long long) b.depth, (double) ns / iterations);
+    }
+
+    // depth and quotes from a mirror loaded with the seeded rows, and one
+    // order row changing under it
+    void run_mirror(const book& b, int64_t fills, uint64_t iterations) {
+        mirror::books books(self);
+        for (const auto& row : mirror::snapshot_of(self, b.db)) books.apply(row);
+        auto lta_wu = books.find(LTA, WU);
+        uint32_t time = now();
+
+        time_mirror(b, "mirror.depth", iterations, [&]() {
+            books.depth(*lta_wu, bid, 10, time);
+        });
+        time_mirror(b, "mirror.sell", iterations, [&]() {
+            books.quote_sell(*lta_wu, taker, asset(units(LTA, fills) / 2, LTA), 0, 0, time);
+        });
+        time_mirror(b, "mirror.buy", iterations, [&]() {
+            books.quote_buy(*lta_wu, taker, asset(units(WU, fills), WU), 0, time);
+        });
+
+        // the best bid is half filled, then restored
+        auto row = lta_wu->rows.begin()->second;
+        auto half = row;
+        half.amount /= 2;
+        mirror::row_change changes[] = {
+                {N(markets), lta_wu->pair.id, row.id, true, pack(half)},
+                {N(markets), lta_wu->pair.id, row.id, true, pack(row)}
+        };
+        uint64_t i = 0;
+        time_mirror(b, "mirror.apply", iterations, [&]() {
+            books.apply(changes[i++ % 2]);
+        });
+    }
+
+    // RAM billed per resting order for the current row, the same order
+    // expiring and the pre-compaction row
+    void ram_per_row(uint64_t depth) {
+        reset();
+        as_contract(self, [&]() {
+            markets_table compact(self, 0);
+            wide_markets_table wide(self, 1);
+            markets_table expiring(self, 2);
+            expiring_table expiring_orders(self, 2);
+            for (uint64_t i = 0; i < depth; i++) {
+                auto maker = numbered_name("mk", i % MAKERS);
+                compact.emplace(maker, [&](auto& s) {
+                    s = exchange_state{i, maker, ask, units(WU, 1), 50000000 + i * 10000, 0, 0, 0, 0};
+                });
+                wide.emplace(maker, [&](auto& s) {
+                    s = wide_exchange_state{i, maker, asset(units(WU, 1), WU), LTA, 50000000 + i * 10000};
+                });
+                expiring.emplace(maker, [&](auto& s) {
+                    s = exchange_state{i, maker, ask, units(WU, 1), 50000000 + i * 10000, 1600000000, 0, 0, 0};
+                });
+                expiring_orders.emplace(maker, [&](auto& e) {
+                    e = expiring_order{i, 1600000000};
+                });
+            }
+        });
+
+        printf("%-14s %8s %12s %12s\n", "markets row", "rows", "data/row", "RAM/row");
+        const char* labels[] = {"compact", "wide", "expiring"};
+        for (uint64_t scope = 0; scope < 3; scope++) {
+            uint64_t rows = 0;
+            uint64_t ram = table_ram(self, scope, N(markets), &rows) + table_ram(self, scope, N(expiring));
+            uint64_t data = 0;
+            for (auto& r : find_table(self, scope, N(markets))->rows) data += r.second.data.size();
+            printf("%-14s %8llu %12.1f %12.1f\n", labels[scope], (unsigned long long) rows,
+                   (double) data / rows, (double) ram / rows);
+        }
+        printf("\n");
+    }
+
+} // namespace
+
+int main(int argc, char** argv) {
+    uint64_t max_depth = argc > 1 ? strtoull(argv[1], nullptr, 10) : 100000;
+    uint64_t iterations = argc > 2 ? strtoull(argv[2], nullptr, 10) : 20;
+
+    ram_per_row(max_depth < 1000 ? max_depth : 1000);
+
+    printf("%-14s %8s %12s %10s %10s %10s %10s\n",
+           "action", "depth", "ns/op", "reads", "writes", "table ops", "inline");
+    for (uint64_t depth = 10; depth <= max_depth; depth *= 10) {
+        auto b = seed(depth);
+        int64_t fills = depth < 10 ? (int64_t) depth : 10;
+
+        run(b, "market.trade", N(market.trade),
+            exchange::market_trade{taker, LTA, asset(units(WU, fills), WU), 0, 0}, taker, iterations);
+        run(b, "limit.trade", N(limit.trade),
+            exchange::limit_trade{taker, asset(units(LTA, fills) / 2, LTA), WU, 0, 0, 0}, taker, iterations);
+        run(b, "trade", N(trade),
+            exchange::trade{taker, asset(units(LTA, fills) / 2, LTA), asset(0, LTB)}, taker, iterations);
+        run(b, "createx", N(createx),
+            exchange::createx{quoter, asset(units(WU, 1), WU), asset(units(LTA, 1), LTA), 0}, quoter, iterations);
+
+        // LADDER_LEVELS bids on LTB/WU below its asks, as separate orders and as one ladder
+        std::vector<exchange::level> levels;
+        for (uint64_t i = 0; i < LADDER_LEVELS; i++) {
+            levels.push_back(exchange::level{asset(units(WU, 1), WU), asset(units(LTB, 1) + (int64_t) i * 10, LTB)});
+        }
+        run(b, "createmany", N(createmany), exchange::createmany{quoter, levels}, quoter, iterations);
+        run(b, "createladder", N(createladder),
+            exchange::createladder{quoter, asset(units(WU, 1), WU), LTB, 100000000, 100000, LADDER_LEVELS, 0},
+            quoter, iterations);
+        run_mirror(b, fills, iterations);
+    }
+    return 0;
+}
@@ -0,0 +1,4 @@
+#define LT_ACCOUNT lt.deployer
+#define WU_ACCOUNT wu.deployer
+#define WU_SYMBOL WU
+#define WU_DECIMALS 4
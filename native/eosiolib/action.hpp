@@ -0,0 +1,95 @@
+#pragma once
+
+#include <eosiolib/datastream.hpp>
+#include <eosiolib/types.hpp>
+#include <eosiolib/serialize.hpp>
+
+namespace eosio {
+
+    using std::vector;
+
+    inline uint32_t action_data_size() {
+        return (uint32_t) native::ctx().action_data.size();
+    }
+
+    inline uint32_t read_action_data(void* msg, uint32_t len) {
+        auto& data = native::ctx().action_data;
+        uint32_t size = len < data.size() ? len : (uint32_t) data.size();
+        memcpy(msg, data.data(), size);
+        return size;
+    }
+
+    template<typename T>
+    T unpack_action_data() {
+        auto& data = native::ctx().action_data;
+        return unpack<T>(data.data(), data.size());
+    }
+
+    inline bool has_auth(account_name name) {
+        return native::ctx().auths.count(name) != 0;
+    }
+
+    inline void require_auth(account_name name) {
+        eosio_assert(has_auth(name), ("missing authority of " + eosio::name{name}.to_string()).c_str());
+    }
+
+    inline void require_recipient(account_name) {}
+
+    inline bool is_account(account_name) { return true; }
+
+    struct permission_level {
+        permission_level(account_name a, permission_name p) : actor(a), permission(p) {}
+
+        permission_level() {}
+
+        account_name actor = 0;
+        permission_name permission = 0;
+
+        friend bool operator==(const permission_level& a, const permission_level& b) {
+            return std::tie(a.actor, a.permission) == std::tie(b.actor, b.permission);
+        }
+
+        EOSLIB_SERIALIZE(permission_level, (actor)(permission))
+    };
+
+    inline void require_auth(const permission_level& level) {
+        require_auth(level.actor);
+    }
+
+    struct action {
+        account_name account = 0;
+        action_name name = 0;
+        vector<permission_level> authorization;
+        vector<char> data;
+
+        action() = default;
+
+        template<typename T>
+        action(const permission_level& auth, account_name a, action_name n, T&& value)
+                : account(a), name(n), authorization(1, auth), data(pack(std::forward<T>(value))) {}
+
+        template<typename T>
+        action(vector<permission_level> auths, account_name a, action_name n, T&& value)
+                : account(a), name(n), authorization(std::move(auths)), data(pack(std::forward<T>(value))) {}
+
+        void send() const {
+            // the chain only lets an action act as its receiver or as an account that signed it
+            native::sent_action sent{account, name, {}, data};
+            for (auto& p : authorization) {
+                eosio_assert(p.actor == native::ctx().receiver || has_auth(p.actor) || native::ctx().seeding,
+                             ("missing authority of " + eosio::name{p.actor}.to_string()).c_str());
+                sent.authorization.emplace_back(p.actor, p.permission);
+            }
+            native::ctx().actions.push_back(std::move(sent));
+            native::ctx().stats.inline_actions++;
+        }
+
+        template<typename T>
+        T data_as() {
+            return unpack<T>(data.data(), data.size());
+        }
+
+        EOSLIB_SERIALIZE(action, (account)(name)(authorization)(data))
+    };
+
+} // namespace eosio
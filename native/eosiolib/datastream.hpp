@@ -0,0 +1,262 @@
+#pragma once
+
+#include <eosiolib/system.h>
+#include <eosiolib/serialize.hpp>
+#include <array>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace eosio {
+
+    template<typename T>
+    class datastream {
+    public:
+        datastream(T start, size_t s) : _start(start), _pos(start), _end(start + s) {}
+
+        inline void skip(size_t s) { _pos += s; }
+
+        inline bool read(char* d, size_t s) {
+            eosio_assert(size_t(_end - _pos) >= s, "read");
+            memcpy(d, _pos, s);
+            _pos += s;
+            return true;
+        }
+
+        inline bool write(const char* d, size_t s) {
+            eosio_assert(_end - _pos >= (int32_t) s, "write");
+            memcpy((void*) _pos, d, s);
+            _pos += s;
+            return true;
+        }
+
+        inline T pos() const { return _pos; }
+
+        inline size_t tellp() const { return size_t(_pos - _start); }
+
+        inline size_t remaining() const { return _end - _pos; }
+
+    private:
+        T _start;
+        T _pos;
+        T _end;
+    };
+
+    template<>
+    class datastream<size_t> {
+    public:
+        datastream(size_t init_size = 0) : _size(init_size) {}
+
+        inline bool skip(size_t s) {
+            _size += s;
+            return true;
+        }
+
+        inline bool write(const char*, size_t s) {
+            _size += s;
+            return true;
+        }
+
+        inline size_t tellp() const { return _size; }
+
+    private:
+        size_t _size;
+    };
+
+    // trivially copyable scalars are written in host (little-endian) order
+    template<typename Stream, typename T, std::enable_if_t<std::is_arithmetic<T>::value || std::is_enum<T>::value
+                                                           || std::is_same<T, uint128_t>::value
+                                                           || std::is_same<T, int128_t>::value, int> = 0>
+    Stream& operator<<(Stream& ds, const T& v) {
+        ds.write((const char*) &v, sizeof(v));
+        return ds;
+    }
+
+    template<typename Stream, typename T, std::enable_if_t<std::is_arithmetic<T>::value || std::is_enum<T>::value
+                                                           || std::is_same<T, uint128_t>::value
+                                                           || std::is_same<T, int128_t>::value, int> = 0>
+    Stream& operator>>(Stream& ds, T& v) {
+        ds.read((char*) &v, sizeof(v));
+        return ds;
+    }
+
+    template<typename Stream>
+    Stream& operator<<(Stream& ds, const checksum256& d) {
+        ds.write((const char*) d.hash, sizeof(d.hash));
+        return ds;
+    }
+
+    template<typename Stream>
+    Stream& operator>>(Stream& ds, checksum256& d) {
+        ds.read((char*) d.hash, sizeof(d.hash));
+        return ds;
+    }
+
+    struct unsigned_int {
+        uint32_t value;
+    };
+
+    template<typename Stream>
+    Stream& operator<<(Stream& ds, const unsigned_int& v) {
+        uint64_t val = v.value;
+        do {
+            uint8_t b = uint8_t(val) & 0x7f;
+            val >>= 7;
+            b |= ((val > 0) << 7);
+            ds.write((const char*) &b, 1);
+        } while (val);
+        return ds;
+    }
+
+    template<typename Stream>
+    Stream& operator>>(Stream& ds, unsigned_int& vi) {
+        uint64_t v = 0;
+        char b = 0;
+        uint8_t by = 0;
+        do {
+            ds.read(&b, 1);
+            v |= uint32_t(uint8_t(b) & 0x7f) << by;
+            by += 7;
+        } while (uint8_t(b) & 0x80);
+        vi.value = static_cast<uint32_t>(v);
+        return ds;
+    }
+
+    template<typename Stream>
+    Stream& operator<<(Stream& ds, const std::string& v) {
+        ds << unsigned_int{(uint32_t) v.size()};
+        if (v.size()) ds.write(v.data(), v.size());
+        return ds;
+    }
+
+    template<typename Stream>
+    Stream& operator>>(Stream& ds, std::string& v) {
+        unsigned_int s;
+        ds >> s;
+        v.resize(s.value);
+        if (s.value) ds.read(&v[0], s.value);
+        return ds;
+    }
+
+    template<typename Stream, typename T>
+    Stream& operator<<(Stream& ds, const std::vector<T>& v) {
+        ds << unsigned_int{(uint32_t) v.size()};
+        for (const auto& i : v) ds << i;
+        return ds;
+    }
+
+    template<typename Stream, typename T>
+    Stream& operator>>(Stream& ds, std::vector<T>& v) {
+        unsigned_int s;
+        ds >> s;
+        v.resize(s.value);
+        for (auto& i : v) ds >> i;
+        return ds;
+    }
+
+    template<typename Stream, typename... Args>
+    Stream& operator<<(Stream& ds, const std::tuple<Args...>& t) {
+        std::apply([&ds](const auto&... a) { ((ds << a), ...); }, t);
+        return ds;
+    }
+
+    template<typename Stream, typename... Args>
+    Stream& operator>>(Stream& ds, std::tuple<Args...>& t) {
+        std::apply([&ds](auto&... a) { ((ds >> a), ...); }, t);
+        return ds;
+    }
+
+    // eosiolib reflects plain aggregates field by field (boost::pfr); the
+    // host build does the same with structured bindings
+    namespace reflect {
+        struct any_field {
+            template<typename U>
+            operator U() const;
+        };
+
+        template<size_t>
+        using any_at = any_field;
+
+        template<typename T, size_t... I>
+        constexpr auto probe(std::index_sequence<I...>) -> decltype(T{any_at<I>{}...}, true) { return true; }
+
+        template<typename T>
+        constexpr bool probe(...) { return false; }
+
+        // counts down from the largest arity, since members with explicit
+        // default constructors (asset) reject shorter initializer lists
+        template<typename T, size_t N = 10>
+        constexpr size_t fields() {
+            if constexpr (N == 0) {
+                return 0;
+            } else if constexpr (probe<T>(std::make_index_sequence<N>())) {
+                return N;
+            } else {
+                return fields<T, N - 1>();
+            }
+        }
+
+        template<typename T, typename F>
+        void visit(T& t, F&& f) {
+            constexpr size_t n = fields<std::remove_const_t<T>>();
+            static_assert(n <= 10, "aggregate has too many fields to reflect");
+            if constexpr (n == 1) { auto& [a] = t; f(a); }
+            else if constexpr (n == 2) { auto& [a, b] = t; f(a); f(b); }
+            else if constexpr (n == 3) { auto& [a, b, c] = t; f(a); f(b); f(c); }
+            else if constexpr (n == 4) { auto& [a, b, c, d] = t; f(a); f(b); f(c); f(d); }
+            else if constexpr (n == 5) { auto& [a, b, c, d, e] = t; f(a); f(b); f(c); f(d); f(e); }
+            else if constexpr (n == 6) { auto& [a, b, c, d, e, g] = t; f(a); f(b); f(c); f(d); f(e); f(g); }
+            else if constexpr (n == 7) { auto& [a, b, c, d, e, g, h] = t; f(a); f(b); f(c); f(d); f(e); f(g); f(h); }
+            else if constexpr (n == 8) { auto& [a, b, c, d, e, g, h, i] = t; f(a); f(b); f(c); f(d); f(e); f(g); f(h); f(i); }
+            else if constexpr (n == 9) { auto& [a, b, c, d, e, g, h, i, j] = t; f(a); f(b); f(c); f(d); f(e); f(g); f(h); f(i); f(j); }
+            else if constexpr (n == 10) { auto& [a, b, c, d, e, g, h, i, j, k] = t; f(a); f(b); f(c); f(d); f(e); f(g); f(h); f(i); f(j); f(k); }
+        }
+
+        template<typename T>
+        constexpr bool is_reflectable = std::is_class<T>::value && std::is_aggregate<T>::value;
+    }
+
+    template<typename Stream, typename T, std::enable_if_t<reflect::is_reflectable<T>, int> = 0>
+    Stream& operator<<(Stream& ds, const T& t) {
+        reflect::visit(t, [&ds](const auto& field) { ds << field; });
+        return ds;
+    }
+
+    template<typename Stream, typename T, std::enable_if_t<reflect::is_reflectable<T>, int> = 0>
+    Stream& operator>>(Stream& ds, T& t) {
+        reflect::visit(t, [&ds](auto& field) { ds >> field; });
+        return ds;
+    }
+
+    template<typename T>
+    size_t pack_size(const T& value) {
+        datastream<size_t> ps;
+        ps << value;
+        return ps.tellp();
+    }
+
+    template<typename T>
+    std::vector<char> pack(const T& value) {
+        std::vector<char> result;
+        result.resize(pack_size(value));
+        datastream<char*> ds(result.data(), result.size());
+        ds << value;
+        return result;
+    }
+
+    template<typename T>
+    T unpack(const char* buffer, size_t len) {
+        T result;
+        datastream<const char*> ds(buffer, len);
+        ds >> result;
+        return result;
+    }
+
+    template<typename T>
+    T unpack(const std::vector<char>& bytes) {
+        return unpack<T>(bytes.data(), bytes.size());
+    }
+
+} // namespace eosio
@@ -0,0 +1,54 @@
+#pragma once
+
+// The secondary index intrinsics a contract calls directly, for entries
+// of an index its current table layout no longer declares. An index's
+// table is named after its table, with the index number in the low 4 bits.
+
+#include <eosiolib/multi_index.hpp>
+
+namespace eosio {
+    namespace native {
+
+        struct index_entry {
+            table_id table;
+            uint64_t number;
+            uint64_t secondary;
+            uint64_t primary;
+        };
+
+        // the entries db_idx64_find_primary returned, by iterator
+        inline std::vector<index_entry>& index_iterators() {
+            static std::vector<index_entry> entries;
+            return entries;
+        }
+
+    } // namespace native
+} // namespace eosio
+
+inline int32_t db_idx64_find_primary(uint64_t code, uint64_t scope, uint64_t table, uint64_t* secondary,
+                                     uint64_t primary) {
+    using namespace eosio::native;
+    auto name = table & 0xFFFFFFFFFFFFFFF0ULL;
+    auto number = table & 0xFULL;
+    auto t = find_table(code, scope, name);
+    if (!t) return -1;
+    auto index = t->indices.find(number * 16 + key_tag<uint64_t>::value);
+    if (index == t->indices.end() || !index->second.data) return -1;
+    ctx().stats.db_reads++;
+    for (const auto& entry : *std::static_pointer_cast<index_set<uint64_t>>(index->second.data)) {
+        if (entry.second != primary) continue;
+        *secondary = entry.first;
+        index_iterators().push_back(index_entry{table_id(code, scope, name), number, entry.first, primary});
+        return (int32_t) index_iterators().size() - 1;
+    }
+    return -1;
+}
+
+inline void db_idx64_remove(int32_t iterator) {
+    using namespace eosio::native;
+    eosio_assert(iterator >= 0 && (size_t) iterator < index_iterators().size(), "invalid index iterator");
+    const auto& entry = index_iterators()[iterator];
+    auto& t = table(std::get<0>(entry.table), std::get<1>(entry.table), std::get<2>(entry.table));
+    index_of<uint64_t>(t, entry.number).erase(std::make_pair(entry.secondary, entry.primary));
+    ctx().stats.db_erases++;
+}
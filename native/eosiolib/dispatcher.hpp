@@ -0,0 +1,28 @@
+#pragma once
+
+#include <eosiolib/action.hpp>
+#include <boost/preprocessor/seq/for_each.hpp>
+#include <boost/preprocessor/stringize.hpp>
+#include <tuple>
+
+namespace eosio {
+
+    template<typename T, typename Q, typename... Args>
+    bool execute_action(T* obj, void (Q::*func)(Args...)) {
+        auto args = unpack_action_data<std::tuple<std::decay_t<Args>...>>();
+        auto f2 = [&](auto... a) {
+            (obj->*func)(a...);
+        };
+        std::apply(f2, args);
+        return true;
+    }
+
+#define EOSIO_API_CALL(r, OP, elem) \
+   case ::eosio::string_to_name( BOOST_PP_STRINGIZE(elem) ): \
+      eosio::execute_action( &thiscontract, &OP::elem ); \
+      break;
+
+#define EOSIO_API(TYPE, MEMBERS) \
+   BOOST_PP_SEQ_FOR_EACH( EOSIO_API_CALL, TYPE, MEMBERS )
+
+} // namespace eosio
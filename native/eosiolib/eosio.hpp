@@ -0,0 +1,8 @@
+#pragma once
+
+#include <eosiolib/types.hpp>
+#include <eosiolib/print.hpp>
+#include <eosiolib/action.hpp>
+#include <eosiolib/multi_index.hpp>
+#include <eosiolib/dispatcher.hpp>
+#include <eosiolib/contract.hpp>
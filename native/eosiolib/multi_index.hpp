@@ -0,0 +1,511 @@
+#pragma once
+
+// In-memory multi_index with the eosiolib interface. Rows are kept
+// serialized (so RAM per row can be measured) and objects are cached per
+// table instance the same way the chain library caches them.
+
+#include <eosiolib/datastream.hpp>
+#include <eosiolib/types.hpp>
+#include <boost/multi_index/mem_fun.hpp>
+#include <iterator>
+#include <limits>
+#include <map>
+#include <memory>
+#include <set>
+#include <type_traits>
+
+namespace eosio {
+
+    using boost::multi_index::const_mem_fun;
+
+    template<uint64_t IndexName, typename Extractor>
+    struct indexed_by {
+        enum constants { index_name = IndexName };
+        typedef Extractor secondary_extractor_type;
+    };
+
+    namespace native {
+        template<typename K>
+        struct key_tag;
+        template<> struct key_tag<uint64_t> { static constexpr uint64_t value = 1; };
+        template<> struct key_tag<uint128_t> { static constexpr uint64_t value = 2; };
+        template<> struct key_tag<double> { static constexpr uint64_t value = 3; };
+        template<> struct key_tag<long double> { static constexpr uint64_t value = 4; };
+
+        template<typename K>
+        using index_set = std::set<std::pair<K, uint64_t>>;
+
+        template<typename K>
+        index_set<K>& index_of(table_store& store, uint64_t number) {
+            auto& slot = store.indices[number * 16 + key_tag<K>::value];
+            if (!slot.data) {
+                slot.data = std::make_shared<index_set<K>>();
+                slot.clone = [](const void* other) -> std::shared_ptr<void> {
+                    return std::make_shared<index_set<K>>(*static_cast<const index_set<K>*>(other));
+                };
+                slot.size = [](const void* data) -> size_t {
+                    return static_cast<const index_set<K>*>(data)->size();
+                };
+            }
+            return *std::static_pointer_cast<index_set<K>>(slot.data);
+        }
+
+        // the chain bills added RAM only to the receiver or to an account that signed the action
+        inline void bill_ram(account_name payer) {
+            auto& c = ctx();
+            eosio_assert(payer == c.receiver || c.auths.count(payer) || c.seeding,
+                         ("missing authority of " + name{payer}.to_string()).c_str());
+        }
+    }
+
+    template<uint64_t TableName, typename T, typename... Indices>
+    class multi_index {
+    private:
+        static_assert(sizeof...(Indices) <= 16, "multi_index only supports a maximum of 16 secondary indices");
+
+        uint64_t _code;
+        uint64_t _scope;
+        mutable std::map<uint64_t, std::unique_ptr<T>> _items;
+
+        native::table_store& store() const { return native::table(_code, _scope, TableName); }
+
+        template<size_t I>
+        using index_at = std::tuple_element_t<I, std::tuple<Indices...>>;
+
+        template<size_t I>
+        using key_at = std::decay_t<typename index_at<I>::secondary_extractor_type::result_type>;
+
+        template<size_t I>
+        static key_at<I> key_of(const T& obj) {
+            return typename index_at<I>::secondary_extractor_type()(obj);
+        }
+
+        template<typename F, size_t... Is>
+        static void for_each_index(F&& f, std::index_sequence<Is...>) {
+            (f(std::integral_constant<size_t, Is>()), ...);
+        }
+
+        template<typename F>
+        static void for_each_index(F&& f) {
+            for_each_index(std::forward<F>(f), std::index_sequence_for<Indices...>());
+        }
+
+        const T* load(uint64_t pk) const {
+            auto cached = _items.find(pk);
+            if (cached != _items.end()) return cached->second.get();
+            auto& rows = store().rows;
+            auto itr = rows.find(pk);
+            if (itr == rows.end()) return nullptr;
+            native::ctx().stats.db_reads++;
+            auto item = std::make_unique<T>(unpack<T>(itr->second.data));
+            auto ptr = item.get();
+            _items.emplace(pk, std::move(item));
+            return ptr;
+        }
+
+    public:
+        multi_index(uint64_t code, uint64_t scope) : _code(code), _scope(scope) {}
+
+        multi_index(multi_index&&) = default;
+
+        uint64_t get_code() const { return _code; }
+
+        uint64_t get_scope() const { return _scope; }
+
+        struct const_iterator {
+            typedef std::bidirectional_iterator_tag iterator_category;
+            typedef const T value_type;
+            typedef std::ptrdiff_t difference_type;
+            typedef const T* pointer;
+            typedef const T& reference;
+
+            friend bool operator==(const const_iterator& a, const const_iterator& b) {
+                return a._end == b._end && (a._end || a._pk == b._pk);
+            }
+
+            friend bool operator!=(const const_iterator& a, const const_iterator& b) {
+                return !(a == b);
+            }
+
+            const T& operator*() const {
+                eosio_assert(!_end, "cannot dereference end iterator");
+                auto item = _multidx->load(_pk);
+                eosio_assert(item != nullptr, "iterator points to erased object");
+                return *item;
+            }
+
+            const T* operator->() const { return &**this; }
+
+            const_iterator operator++(int) {
+                const_iterator result(*this);
+                ++(*this);
+                return result;
+            }
+
+            const_iterator operator--(int) {
+                const_iterator result(*this);
+                --(*this);
+                return result;
+            }
+
+            const_iterator& operator++() {
+                eosio_assert(!_end, "cannot increment end iterator");
+                auto& rows = _multidx->store().rows;
+                auto next = rows.upper_bound(_pk);
+                if (next == rows.end()) {
+                    _end = true;
+                } else {
+                    _pk = next->first;
+                }
+                return *this;
+            }
+
+            const_iterator& operator--() {
+                auto& rows = _multidx->store().rows;
+                auto pos = _end ? rows.end() : rows.lower_bound(_pk);
+                eosio_assert(pos != rows.begin(), "cannot decrement iterator at beginning of table");
+                --pos;
+                _pk = pos->first;
+                _end = false;
+                return *this;
+            }
+
+            const_iterator() {}
+
+        private:
+            const_iterator(const multi_index* mi, uint64_t pk, bool end) : _multidx(mi), _pk(pk), _end(end) {}
+
+            const multi_index* _multidx = nullptr;
+            uint64_t _pk = 0;
+            bool _end = true;
+
+            friend class multi_index;
+        };
+
+        typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
+
+        template<uint64_t IndexName, size_t Number>
+        struct index {
+        private:
+            typedef key_at<Number> secondary_key_type;
+            typedef native::index_set<secondary_key_type> set_type;
+
+            const multi_index* _multidx;
+
+            static set_type& keys(const multi_index* mi) { return native::index_of<secondary_key_type>(mi->store(), Number); }
+
+            set_type& keys() const { return keys(_multidx); }
+
+        public:
+            index(const multi_index* mi) : _multidx(mi) {}
+
+            static constexpr uint64_t name() { return IndexName; }
+
+            static constexpr uint64_t number() { return Number; }
+
+            struct const_iterator {
+                typedef std::bidirectional_iterator_tag iterator_category;
+                typedef const T value_type;
+                typedef std::ptrdiff_t difference_type;
+                typedef const T* pointer;
+                typedef const T& reference;
+
+                friend bool operator==(const const_iterator& a, const const_iterator& b) {
+                    return a._end == b._end && (a._end || a._pk == b._pk);
+                }
+
+                friend bool operator!=(const const_iterator& a, const const_iterator& b) {
+                    return !(a == b);
+                }
+
+                const T& operator*() const {
+                    eosio_assert(!_end, "cannot dereference end iterator");
+                    auto item = _multidx->load(_pk);
+                    eosio_assert(item != nullptr, "iterator points to erased object");
+                    return *item;
+                }
+
+                const T* operator->() const { return &**this; }
+
+                const_iterator operator++(int) {
+                    const_iterator result(*this);
+                    ++(*this);
+                    return result;
+                }
+
+                const_iterator operator--(int) {
+                    const_iterator result(*this);
+                    --(*this);
+                    return result;
+                }
+
+                // the position is recomputed from the row's current key, so an
+                // iterator stays valid across a modify of the row it points to
+                const_iterator& operator++() {
+                    eosio_assert(!_end, "cannot increment end iterator");
+                    auto& set = index::keys(_multidx);
+                    auto next = set.upper_bound(std::make_pair(key_of<Number>(**this), _pk));
+                    if (next == set.end()) {
+                        _end = true;
+                    } else {
+                        _pk = next->second;
+                    }
+                    return *this;
+                }
+
+                const_iterator& operator--() {
+                    auto& set = index::keys(_multidx);
+                    auto pos = _end ? set.end() : set.lower_bound(std::make_pair(key_of<Number>(**this), _pk));
+                    eosio_assert(pos != set.begin(), "cannot decrement iterator at beginning of index");
+                    --pos;
+                    _pk = pos->second;
+                    _end = false;
+                    return *this;
+                }
+
+                const_iterator() {}
+
+            private:
+                const_iterator(const multi_index* mi, uint64_t pk, bool end) : _multidx(mi), _pk(pk), _end(end) {}
+
+                const multi_index* _multidx = nullptr;
+                uint64_t _pk = 0;
+                bool _end = true;
+
+                friend struct index;
+            };
+
+            typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
+
+            const_iterator make(typename set_type::const_iterator pos) const {
+                auto& set = keys();
+                if (pos == set.end()) return const_iterator(_multidx, 0, true);
+                return const_iterator(_multidx, pos->second, false);
+            }
+
+            const_iterator cbegin() const { return make(keys().begin()); }
+
+            const_iterator begin() const { return cbegin(); }
+
+            const_iterator cend() const { return const_iterator(_multidx, 0, true); }
+
+            const_iterator end() const { return cend(); }
+
+            const_reverse_iterator crbegin() const { return std::make_reverse_iterator(cend()); }
+
+            const_reverse_iterator rbegin() const { return crbegin(); }
+
+            const_reverse_iterator crend() const { return std::make_reverse_iterator(cbegin()); }
+
+            const_reverse_iterator rend() const { return crend(); }
+
+            const_iterator find(secondary_key_type secondary) const {
+                auto lb = lower_bound(secondary);
+                if (lb == end() || key_of<Number>(*lb) != secondary) return end();
+                return lb;
+            }
+
+            const_iterator lower_bound(secondary_key_type secondary) const {
+                return make(keys().lower_bound(std::make_pair(secondary, uint64_t(0))));
+            }
+
+            const_iterator upper_bound(secondary_key_type secondary) const {
+                return make(keys().upper_bound(std::make_pair(secondary, std::numeric_limits<uint64_t>::max())));
+            }
+
+            const_iterator iterator_to(const T& obj) const {
+                return const_iterator(_multidx, obj.primary_key(), false);
+            }
+
+            template<typename Lambda>
+            void modify(const_iterator itr, uint64_t payer, Lambda&& updater) {
+                eosio_assert(itr != end(), "cannot pass end iterator to modify");
+                const_cast<multi_index*>(_multidx)->modify(*itr, payer, std::forward<Lambda>(updater));
+            }
+
+            const_iterator erase(const_iterator itr) {
+                eosio_assert(itr != end(), "cannot pass end iterator to erase");
+                const auto& obj = *itr;
+                ++itr;
+                const_cast<multi_index*>(_multidx)->erase(obj);
+                return itr;
+            }
+
+            const T& get(secondary_key_type secondary, const char* error_msg = "unable to find secondary key") const {
+                auto result = find(secondary);
+                eosio_assert(result != cend(), error_msg);
+                return *result;
+            }
+
+            uint64_t get_code() const { return _multidx->get_code(); }
+
+            uint64_t get_scope() const { return _multidx->get_scope(); }
+        };
+
+    private:
+        template<uint64_t IndexName, size_t I = 0>
+        static constexpr size_t index_number() {
+            static_assert(I < sizeof...(Indices), "name provided is not the name of any secondary index within multi_index");
+            if constexpr (uint64_t(index_at<I>::index_name) == IndexName) {
+                return I;
+            } else {
+                return index_number<IndexName, I + 1>();
+            }
+        }
+
+        const_iterator make(uint64_t pk) const { return const_iterator(this, pk, false); }
+
+    public:
+        const_iterator cbegin() const {
+            auto& rows = store().rows;
+            return rows.empty() ? cend() : make(rows.begin()->first);
+        }
+
+        const_iterator begin() const { return cbegin(); }
+
+        const_iterator cend() const { return const_iterator(this, 0, true); }
+
+        const_iterator end() const { return cend(); }
+
+        const_reverse_iterator crbegin() const { return std::make_reverse_iterator(cend()); }
+
+        const_reverse_iterator rbegin() const { return crbegin(); }
+
+        const_reverse_iterator crend() const { return std::make_reverse_iterator(cbegin()); }
+
+        const_reverse_iterator rend() const { return crend(); }
+
+        const_iterator lower_bound(uint64_t primary) const {
+            auto& rows = store().rows;
+            auto itr = rows.lower_bound(primary);
+            return itr == rows.end() ? cend() : make(itr->first);
+        }
+
+        const_iterator upper_bound(uint64_t primary) const {
+            auto& rows = store().rows;
+            auto itr = rows.upper_bound(primary);
+            return itr == rows.end() ? cend() : make(itr->first);
+        }
+
+        uint64_t available_primary_key() const {
+            auto& rows = store().rows;
+            return rows.empty() ? 0 : rows.rbegin()->first + 1;
+        }
+
+        template<uint64_t IndexName>
+        auto get_index() const {
+            return index<IndexName, index_number<IndexName>()>(this);
+        }
+
+        const_iterator iterator_to(const T& obj) const {
+            return make(obj.primary_key());
+        }
+
+        template<typename Lambda>
+        const_iterator emplace(uint64_t payer, Lambda&& constructor) {
+            eosio_assert(_code == current_receiver(), "cannot create objects in table of another contract");
+
+            auto item = std::make_unique<T>();
+            constructor(*item);
+            auto pk = item->primary_key();
+
+            auto& s = store();
+            eosio_assert(s.rows.find(pk) == s.rows.end(), "could not insert object, most likely a uniqueness constraint was violated");
+            native::bill_ram(payer);
+            s.rows[pk] = native::row{pack(*item), payer};
+            native::ctx().stats.db_writes++;
+
+            for_each_index([&](auto i) {
+                constexpr size_t I = decltype(i)::value;
+                native::index_of<key_at<I>>(s, I).emplace(key_of<I>(*item), pk);
+            });
+
+            _items[pk] = std::move(item);
+            return make(pk);
+        }
+
+        template<typename Lambda>
+        void modify(const_iterator itr, uint64_t payer, Lambda&& updater) {
+            eosio_assert(itr != end(), "cannot pass end iterator to modify");
+            modify(*itr, payer, std::forward<Lambda>(updater));
+        }
+
+        template<typename Lambda>
+        void modify(const T& obj, uint64_t payer, Lambda&& updater) {
+            eosio_assert(_code == current_receiver(), "cannot modify objects in table of another contract");
+
+            auto pk = obj.primary_key();
+            auto& mutableobj = const_cast<T&>(obj);
+            auto& s = store();
+
+            std::tuple<key_at_or_void<Indices>...> old_keys;
+            for_each_index([&](auto i) {
+                constexpr size_t I = decltype(i)::value;
+                std::get<I>(old_keys) = key_of<I>(obj);
+            });
+
+            updater(mutableobj);
+
+            eosio_assert(pk == obj.primary_key(), "updater cannot change primary key when modifying an object");
+
+            auto& row = s.rows[pk];
+            auto data = pack(obj);
+            if ((payer && payer != row.payer) || data.size() > row.data.size()) {
+                native::bill_ram(payer ? payer : row.payer);
+            }
+            row.data = std::move(data);
+            if (payer) row.payer = payer;
+            native::ctx().stats.db_writes++;
+
+            for_each_index([&](auto i) {
+                constexpr size_t I = decltype(i)::value;
+                auto key = key_of<I>(obj);
+                if (key != std::get<I>(old_keys)) {
+                    auto& set = native::index_of<key_at<I>>(s, I);
+                    set.erase(std::make_pair(std::get<I>(old_keys), pk));
+                    set.emplace(key, pk);
+                    native::ctx().stats.db_writes++;
+                }
+            });
+        }
+
+        const T& get(uint64_t primary, const char* error_msg = "unable to find key") const {
+            auto result = find(primary);
+            eosio_assert(result != cend(), error_msg);
+            return *result;
+        }
+
+        const_iterator find(uint64_t primary) const {
+            if (_items.count(primary)) return make(primary);
+            auto& rows = store().rows;
+            return rows.find(primary) == rows.end() ? cend() : make(primary);
+        }
+
+        const_iterator erase(const_iterator itr) {
+            eosio_assert(itr != end(), "cannot pass end iterator to erase");
+            const auto& obj = *itr;
+            ++itr;
+            erase(obj);
+            return itr;
+        }
+
+        void erase(const T& obj) {
+            eosio_assert(_code == current_receiver(), "cannot erase objects in table of another contract");
+
+            auto pk = obj.primary_key();
+            auto& s = store();
+            for_each_index([&](auto i) {
+                constexpr size_t I = decltype(i)::value;
+                native::index_of<key_at<I>>(s, I).erase(std::make_pair(key_of<I>(obj), pk));
+            });
+            s.rows.erase(pk);
+            native::ctx().stats.db_erases++;
+            _items.erase(pk);
+        }
+
+    private:
+        template<typename Index>
+        using key_at_or_void = std::decay_t<typename Index::secondary_extractor_type::result_type>;
+    };
+
+} // namespace eosio
@@ -0,0 +1,161 @@
+#pragma once
+
+// Host-side runtime state that stands in for the chain. Everything the
+// contract would observe through intrinsics (action data, authorizations,
+// the database, the clock) lives here so a harness can seed and inspect it.
+
+#include <eosiolib/types.h>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <vector>
+
+namespace eosio {
+    namespace native {
+
+        struct assertion_failure : std::runtime_error {
+            using std::runtime_error::runtime_error;
+        };
+
+        struct exit_request {
+            int32_t code;
+        };
+
+        struct counters {
+            uint64_t db_reads = 0;
+            uint64_t db_writes = 0;
+            uint64_t db_erases = 0;
+            uint64_t inline_actions = 0;
+            uint64_t deferred_transactions = 0;
+            uint64_t prints = 0;
+        };
+
+        struct sent_action {
+            account_name account;
+            action_name name;
+            std::vector<std::pair<account_name, permission_name>> authorization;
+            std::vector<char> data;
+        };
+
+        struct row {
+            std::vector<char> data;
+            account_name payer;
+        };
+
+        // type-erased secondary index that deep-copies with its table, so a
+        // copy of the database is an independent snapshot
+        struct index_store {
+            std::shared_ptr<void> data;
+            std::shared_ptr<void> (*clone)(const void*) = nullptr;
+            size_t (*size)(const void*) = nullptr;
+
+            index_store() = default;
+
+            index_store(const index_store& other)
+                    : data(other.data ? other.clone(other.data.get()) : nullptr), clone(other.clone), size(other.size) {}
+
+            index_store(index_store&&) = default;
+
+            index_store& operator=(const index_store& other) {
+                data = other.data ? other.clone(other.data.get()) : nullptr;
+                clone = other.clone;
+                size = other.size;
+                return *this;
+            }
+
+            index_store& operator=(index_store&&) = default;
+        };
+
+        struct table_store {
+            std::map<uint64_t, row> rows;
+            // secondary indices, keyed by index number and key type; the data
+            // is a std::set<std::pair<Key, uint64_t>>
+            std::map<uint64_t, index_store> indices;
+        };
+
+        typedef std::tuple<uint64_t, uint64_t, uint64_t> table_id;
+
+        struct context {
+            account_name receiver = 0;
+            std::vector<char> action_data;
+            std::set<account_name> auths;
+            // set while a harness seeds tables directly, outside of any action
+            bool seeding = false;
+            std::vector<sent_action> actions;
+            std::vector<sent_action> deferred;
+            std::map<table_id, table_store> db;
+            uint64_t time_us = 1500000000ull * 1000000ull;
+            bool echo_prints = false;
+            std::string printed;
+            counters stats;
+        };
+
+        inline context& ctx() {
+            static context c;
+            return c;
+        }
+
+        inline table_store& table(uint64_t code, uint64_t scope, uint64_t name) {
+            return ctx().db[table_id(code, scope, name)];
+        }
+
+        inline const table_store* find_table(uint64_t code, uint64_t scope, uint64_t name) {
+            auto& db = ctx().db;
+            auto itr = db.find(table_id(code, scope, name));
+            return itr == db.end() ? nullptr : &itr->second;
+        }
+
+        /// total serialized bytes held in every table named `name` owned by `code`
+        inline uint64_t table_bytes(uint64_t code, uint64_t name, uint64_t* rows = nullptr) {
+            uint64_t bytes = 0;
+            uint64_t count = 0;
+            for (auto& t : ctx().db) {
+                if (std::get<0>(t.first) != code || std::get<2>(t.first) != name) continue;
+                for (auto& r : t.second.rows) {
+                    bytes += r.second.data.size();
+                    count++;
+                }
+            }
+            if (rows) *rows = count;
+            return bytes;
+        }
+
+        // what the chain bills for a row and for each secondary index entry,
+        // on top of the serialized data (eosio::chain::config::billable_size)
+        static const uint64_t ROW_OVERHEAD_BYTES = 32 + 8 + 4 + 2 * 32;
+        static const uint64_t INDEX_OVERHEAD_BYTES = 24 + 3 * 32;
+
+        /// RAM billed for one table, as eosio charges it to the row payers
+        inline uint64_t table_ram(uint64_t code, uint64_t scope, uint64_t name, uint64_t* rows = nullptr) {
+            auto t = find_table(code, scope, name);
+            uint64_t bytes = 0;
+            uint64_t count = 0;
+            if (t) {
+                for (auto& r : t->rows) {
+                    bytes += r.second.data.size() + ROW_OVERHEAD_BYTES;
+                    count++;
+                }
+                // indices are keyed by number * 16 + key tag; tags 2 and 4 are 16-byte keys
+                for (auto& index : t->indices) {
+                    uint64_t key_bytes = index.first % 16 == 2 || index.first % 16 == 4 ? 16 : 8;
+                    uint64_t entries = index.second.data ? index.second.size(index.second.data.get()) : 0;
+                    bytes += entries * (INDEX_OVERHEAD_BYTES + key_bytes);
+                }
+            }
+            if (rows) *rows = count;
+            return bytes;
+        }
+
+        /// resets chain state between runs, keeping nothing but the clock
+        inline void reset() {
+            auto time_us = ctx().time_us;
+            ctx() = context();
+            ctx().time_us = time_us;
+        }
+
+    } // namespace native
+} // namespace eosio
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <eosiolib/system.h>
+#include <cstdio>
+#include <type_traits>
+#include <utility>
+
+namespace eosio {
+
+    namespace native {
+        inline void emit(const std::string& s) {
+            ctx().stats.prints++;
+            if (ctx().echo_prints) {
+                ctx().printed += s;
+            }
+        }
+    }
+
+    inline void prints(const char* cstr) { native::emit(cstr); }
+
+    inline void prints_l(const char* cstr, uint32_t len) { native::emit(std::string(cstr, len)); }
+
+    inline void printi(int64_t value) { native::emit(std::to_string(value)); }
+
+    inline void printui(uint64_t value) { native::emit(std::to_string(value)); }
+
+    inline void printui128(const uint128_t* value) {
+        char buf[41];
+        char* p = buf + sizeof(buf) - 1;
+        *p = 0;
+        uint128_t v = *value;
+        do {
+            *--p = char('0' + (int) (v % 10));
+            v /= 10;
+        } while (v);
+        native::emit(p);
+    }
+
+    inline void printdf(double value) {
+        char buf[64];
+        snprintf(buf, sizeof(buf), "%.15e", value);
+        native::emit(buf);
+    }
+
+    void printn(uint64_t name);
+
+    inline void print(const char* ptr) { prints(ptr); }
+
+    inline void print(char c) { prints_l(&c, 1); }
+
+    inline void print(const std::string& s) { prints(s.c_str()); }
+
+    inline void print(double d) { printdf(d); }
+
+    inline void print(float f) { printdf(f); }
+
+    inline void print(uint128_t v) { printui128(&v); }
+
+    template<typename T, std::enable_if_t<std::is_integral<T>::value && std::is_signed<T>::value, int> = 0>
+    inline void print(T v) { printi(v); }
+
+    template<typename T, std::enable_if_t<std::is_integral<T>::value && std::is_unsigned<T>::value, int> = 0>
+    inline void print(T v) { printui(v); }
+
+    template<typename T, std::enable_if_t<std::is_class<T>::value, int> = 0>
+    inline void print(const T& t) { t.print(); }
+
+    template<typename Arg, typename Next, typename... Args>
+    void print(Arg&& a, Next&& n, Args&&... args) {
+        print(std::forward<Arg>(a));
+        print(std::forward<Next>(n), std::forward<Args>(args)...);
+    }
+
+} // namespace eosio
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <boost/preprocessor/seq/for_each.hpp>
+
+#define EOSLIB_REFLECT_MEMBER_OP(r, OP, elem) \
+  OP t.elem
+
+#define EOSLIB_SERIALIZE(TYPE, MEMBERS) \
+ template<typename DataStream> \
+ friend DataStream& operator << (DataStream& ds, const TYPE& t) { \
+    return ds BOOST_PP_SEQ_FOR_EACH(EOSLIB_REFLECT_MEMBER_OP, <<, MEMBERS); \
+ } \
+ template<typename DataStream> \
+ friend DataStream& operator >> (DataStream& ds, TYPE& t) { \
+    return ds BOOST_PP_SEQ_FOR_EACH(EOSLIB_REFLECT_MEMBER_OP, >>, MEMBERS); \
+ }
+
+#define EOSLIB_SERIALIZE_DERIVED(TYPE, BASE, MEMBERS) \
+ template<typename DataStream> \
+ friend DataStream& operator << (DataStream& ds, const TYPE& t) { \
+    ds << static_cast<const BASE&>(t); \
+    return ds BOOST_PP_SEQ_FOR_EACH(EOSLIB_REFLECT_MEMBER_OP, <<, MEMBERS); \
+ } \
+ template<typename DataStream> \
+ friend DataStream& operator >> (DataStream& ds, TYPE& t) { \
+    ds >> static_cast<BASE&>(t); \
+    return ds BOOST_PP_SEQ_FOR_EACH(EOSLIB_REFLECT_MEMBER_OP, >>, MEMBERS); \
+ }
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <eosiolib/native.hpp>
+
+inline void eosio_assert(uint32_t test, const char* msg) {
+    if (!test) throw eosio::native::assertion_failure(msg);
+}
+
+inline void eosio_assert_code(uint32_t test, uint64_t code) {
+    if (!test) throw eosio::native::assertion_failure("assertion failure with error code: " + std::to_string(code));
+}
+
+[[noreturn]] inline void eosio_exit(int32_t code) {
+    throw eosio::native::exit_request{code};
+}
+
+inline uint64_t current_time() {
+    return eosio::native::ctx().time_us;
+}
+
+inline uint32_t now() {
+    return (uint32_t) (current_time() / 1000000);
+}
+
+inline account_name current_receiver() {
+    return eosio::native::ctx().receiver;
+}
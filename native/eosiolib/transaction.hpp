@@ -0,0 +1,49 @@
+#pragma once
+
+#include <eosiolib/action.hpp>
+
+namespace eosio {
+
+    class transaction_header {
+    public:
+        transaction_header(uint32_t exp = now() + 60)
+                : expiration(exp) {}
+
+        uint32_t expiration;
+        uint16_t ref_block_num = 0;
+        uint32_t ref_block_prefix = 0;
+        unsigned_int max_net_usage_words = {0};
+        uint8_t max_cpu_usage_ms = 0;
+        unsigned_int delay_sec = {0};
+
+        EOSLIB_SERIALIZE(transaction_header, (expiration)(ref_block_num)(ref_block_prefix)(max_net_usage_words)(max_cpu_usage_ms)(delay_sec))
+    };
+
+    class transaction : public transaction_header {
+    public:
+        transaction(uint32_t exp = now() + 60) : transaction_header(exp) {}
+
+        void send(const uint128_t& sender_id, account_name payer, bool replace_existing = false) const {
+            (void) sender_id;
+            (void) payer;
+            (void) replace_existing;
+            for (auto& a : actions) {
+                native::sent_action sent{a.account, a.name, {}, a.data};
+                for (auto& p : a.authorization) sent.authorization.emplace_back(p.actor, p.permission);
+                native::ctx().deferred.push_back(std::move(sent));
+            }
+            native::ctx().stats.deferred_transactions++;
+        }
+
+        vector<action> context_free_actions;
+        vector<action> actions;
+
+        EOSLIB_SERIALIZE_DERIVED(transaction, transaction_header, (context_free_actions)(actions))
+    };
+
+    inline int cancel_deferred(const uint128_t& sender_id) {
+        (void) sender_id;
+        return 0;
+    }
+
+} // namespace eosio
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <stdint.h>
+
+typedef uint64_t account_name;
+typedef uint64_t permission_name;
+typedef uint64_t table_name;
+typedef uint64_t scope_name;
+typedef uint64_t action_name;
+typedef uint64_t symbol_name;
+
+typedef unsigned __int128 uint128_t;
+typedef __int128 int128_t;
+
+struct checksum256 {
+    uint8_t hash[32];
+};
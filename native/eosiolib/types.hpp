@@ -0,0 +1,64 @@
+#pragma once
+
+#include <eosiolib/types.h>
+#include <eosiolib/print.hpp>
+#include <string>
+
+namespace eosio {
+
+    static constexpr char char_to_symbol(char c) {
+        if (c >= 'a' && c <= 'z')
+            return (c - 'a') + 6;
+        if (c >= '1' && c <= '5')
+            return (c - '1') + 1;
+        return 0;
+    }
+
+    static constexpr uint64_t string_to_name(const char* str) {
+        uint32_t len = 0;
+        while (str[len]) ++len;
+
+        uint64_t value = 0;
+        for (uint32_t i = 0; i <= 12; ++i) {
+            uint64_t c = 0;
+            if (i < len && i <= 12) c = uint64_t(char_to_symbol(str[i]));
+
+            if (i < 12) {
+                c &= 0x1f;
+                c <<= 64 - 5 * (i + 1);
+            } else {
+                c &= 0x0f;
+            }
+            value |= c;
+        }
+        return value;
+    }
+
+#define N(X) ::eosio::string_to_name(#X)
+
+    struct name {
+        account_name value = 0;
+
+        operator account_name() const { return value; }
+
+        std::string to_string() const {
+            static const char* charmap = ".12345abcdefghijklmnopqrstuvwxyz";
+            std::string str(13, '.');
+            uint64_t tmp = value;
+            for (uint32_t i = 0; i <= 12; ++i) {
+                char c = charmap[tmp & (i == 0 ? 0x0f : 0x1f)];
+                str[12 - i] = c;
+                tmp >>= (i == 0 ? 4 : 5);
+            }
+            auto last = str.find_last_not_of('.');
+            return last == std::string::npos ? std::string() : str.substr(0, last + 1);
+        }
+
+        void print() const { prints(to_string().c_str()); }
+
+        friend bool operator==(const name& a, const name& b) { return a.value == b.value; }
+    };
+
+    inline void printn(uint64_t n) { name{n}.print(); }
+
+} // namespace eosio
@@ -0,0 +1,170 @@
+#pragma once
+
+// Drives the contract through its real `apply` entry point on top of the
+// in-memory eosiolib stand-in, and seeds tables directly for large books.
+
+#include <eosiolib/eosio.hpp>
+#include <chrono>
+#include "../exchange.hpp"
+
+extern "C" void apply(uint64_t receiver, uint64_t code, uint64_t action);
+
+namespace eosio {
+    namespace native {
+
+        struct outcome {
+            bool ok;
+            std::string error;
+            uint64_t ns;
+            counters stats;
+#ifdef EXCHANGE_TRACE
+            // what the contract's own tracing recorded for the action
+            trace::counters trace;
+#endif
+
+            uint64_t table_ops() const { return stats.db_reads + stats.db_writes + stats.db_erases; }
+        };
+
+        inline counters operator-(const counters& a, const counters& b) {
+            counters r;
+            r.db_reads = a.db_reads - b.db_reads;
+            r.db_writes = a.db_writes - b.db_writes;
+            r.db_erases = a.db_erases - b.db_erases;
+            r.inline_actions = a.inline_actions - b.inline_actions;
+            r.deferred_transactions = a.deferred_transactions - b.deferred_transactions;
+            r.prints = a.prints - b.prints;
+            return r;
+        }
+
+        // runs one action from its packed data; with `atomic` a failed
+        // action leaves the tables untouched
+        inline outcome push_packed(account_name self, account_name act, std::vector<char> data,
+                                   std::vector<account_name> auths, bool atomic = true) {
+            auto& c = ctx();
+            c.receiver = self;
+            c.action_data = std::move(data);
+            c.auths = std::set<account_name>(auths.begin(), auths.end());
+            c.actions.clear();
+            c.deferred.clear();
+
+            std::map<table_id, table_store> snapshot;
+            if (atomic) snapshot = c.db;
+
+            outcome result{};
+            result.ok = true;
+            auto before = c.stats;
+            auto start = std::chrono::steady_clock::now();
+            try {
+                ::apply(self, self, act);
+            } catch (exit_request&) {
+            } catch (assertion_failure& e) {
+                result.ok = false;
+                result.error = e.what();
+            }
+            result.ns = (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - start).count();
+            result.stats = c.stats - before;
+#ifdef EXCHANGE_TRACE
+            result.trace = trace::current();
+#endif
+
+            if (!result.ok) {
+                if (atomic) c.db = std::move(snapshot);
+                c.actions.clear();
+                c.deferred.clear();
+            }
+            return result;
+        }
+
+        template<typename T>
+        outcome push(account_name self, account_name act, const T& data,
+                     std::vector<account_name> auths, bool atomic = true) {
+            return push_packed(self, act, pack(data), std::move(auths), atomic);
+        }
+
+        // runs f as if executed by `receiver`, so it may write that contract's tables
+        template<typename F>
+        void as_contract(account_name receiver, F&& f) {
+            auto previous = ctx().receiver;
+            ctx().receiver = receiver;
+            ctx().seeding = true;
+            f();
+            ctx().seeding = false;
+            ctx().receiver = previous;
+        }
+
+        struct symbol_row {
+            symbol_name symbol;
+
+            uint64_t primary_key() const { return symbol; }
+        };
+
+        inline void add_loyalty_token(account_name loyalty_contract, symbol_type symbol) {
+            as_contract(loyalty_contract, [&]() {
+                multi_index<N(symbols), symbol_row> symbols(loyalty_contract, loyalty_contract);
+                symbols.emplace(loyalty_contract, [&](auto& s) { s.symbol = symbol; });
+            });
+        }
+
+        inline uint64_t add_pair(account_name self, symbol_type base_symbol, symbol_type quote_symbol) {
+            uint64_t id = 0;
+            as_contract(self, [&]() {
+                pairs_table pairs(self, self);
+                id = pairs.available_primary_key();
+                pairs.emplace(self, [&](auto& p) {
+                    p.id = id;
+                    p.base_symbol = base_symbol;
+                    p.quote_symbol = quote_symbol;
+                });
+            });
+            return id;
+        }
+
+        inline void add_order(account_name self, uint64_t pair_id, account_name manager, uint8_t side,
+                              int64_t amount, uint64_t price, uint32_t expiration = 0) {
+            as_contract(self, [&]() {
+                markets_table markets(self, pair_id);
+                uint64_t id = markets.available_primary_key();
+                markets.emplace(manager, [&](auto& s) {
+                    s.id = id;
+                    s.manager = manager;
+                    s.side = side;
+                    s.amount = amount;
+                    s.price = price;
+                    s.expiration = expiration;
+                    s.step = 0;
+                    s.levels = 0;
+                    s.size = 0;
+                });
+                if (expiration) {
+                    expiring_table expiring(self, pair_id);
+                    expiring.emplace(manager, [&](auto& e) {
+                        e.id = id;
+                        e.expiration = expiration;
+                    });
+                }
+            });
+        }
+
+        // builds the pair's ticker row from a seeded book, as the first action touching it would
+        inline void add_ticker(account_name self, uint64_t pair_id) {
+            as_contract(self, [&]() {
+                tickers ticks(self);
+                ticks.rest(pair_id, ask, 0, 0);
+                ticks.flush();
+            });
+        }
+
+        // a valid account name for any index, e.g. numbered_name("mk", 42)
+        inline account_name numbered_name(const char* prefix, uint64_t n) {
+            static const char* charmap = "abcdefghijklmnopqrstuvwxyz12345";
+            std::string str(prefix);
+            do {
+                str += charmap[n % 31];
+                n /= 31;
+            } while (n);
+            return string_to_name(str.c_str());
+        }
+
+    } // namespace native
+} // namespace eosio
@@ -0,0 +1,243 @@
+#include "mirror.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+namespace eosio {
+    namespace mirror {
+
+        void side_book::insert(uint128_t key, const exchange_state& level, bool front) {
+            auto at = std::lower_bound(keys.begin(), keys.end(), key) - keys.begin();
+            keys.insert(keys.begin() + at, key);
+            prices.insert(prices.begin() + at, level.price);
+            amounts.insert(amounts.begin() + at, level.amount);
+            ids.insert(ids.begin() + at, level.id);
+            managers.insert(managers.begin() + at, level.manager);
+            expirations.insert(expirations.begin() + at, level.expiration);
+            fronts.insert(fronts.begin() + at, front);
+        }
+
+        void side_book::erase(uint128_t key) {
+            auto at = std::lower_bound(keys.begin(), keys.end(), key) - keys.begin();
+            if (at == (ptrdiff_t) keys.size() || keys[at] != key) return;
+            keys.erase(keys.begin() + at);
+            prices.erase(prices.begin() + at);
+            amounts.erase(amounts.begin() + at);
+            ids.erase(ids.begin() + at);
+            managers.erase(managers.begin() + at);
+            expirations.erase(expirations.begin() + at);
+            fronts.erase(fronts.begin() + at);
+        }
+
+        bool side_book::update(uint128_t key, const exchange_state& level) {
+            auto at = std::lower_bound(keys.begin(), keys.end(), key) - keys.begin();
+            if (at == (ptrdiff_t) keys.size() || keys[at] != key) return false;
+            amounts[at] = level.amount;
+            managers[at] = level.manager;
+            expirations[at] = level.expiration;
+            return true;
+        }
+
+        void books::load(const std::string& path) {
+            std::ifstream file(path, std::ios::binary);
+            if (!file) throw std::runtime_error("can't open snapshot " + path);
+            std::vector<char> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+            _books.clear();
+            _by_symbols.clear();
+            for (const auto& change : unpack<std::vector<row_change>>(bytes)) {
+                apply(change);
+            }
+        }
+
+        void books::apply(const row_change& change) {
+            if (change.table == N(pairs) && change.scope == _contract) {
+                _apply_pair(change);
+            } else if (change.table == N(reserves) && change.scope == _contract) {
+                _books[change.primary_key].reserve = change.present ? unpack<reserve_t>(change.data) : reserve_t{};
+            } else if (change.table == N(markets)) {
+                _apply_order(change);
+            }
+        }
+
+        void books::_apply_pair(const row_change& change) {
+            // a book's orders may arrive before its pair, so books are keyed
+            // by id and only listed by symbols once the pair is known
+            auto existing = _books.find(change.primary_key);
+            if (existing != _books.end() && existing->second.pair.id == change.primary_key) {
+                _by_symbols.erase(existing->second.pair.get_symbols());
+            }
+            if (!change.present) {
+                _books.erase(change.primary_key);
+                return;
+            }
+
+            auto& b = _books[change.primary_key];
+            b.pair = unpack<pair_t>(change.data);
+            _by_symbols[b.pair.get_symbols()] = b.pair.id;
+        }
+
+        void books::_apply_order(const row_change& change) {
+            auto& b = _books[change.scope];
+            auto old = b.rows.find(change.primary_key);
+            if (old != b.rows.end() && change.present) {
+                // a partial fill leaves every level where it was, so its
+                // entries are overwritten in place
+                auto order = unpack<exchange_state>(change.data);
+                const auto& was = old->second;
+                if (order.side == was.side && order.price == was.price && order.levels == was.levels
+                    && order.step == was.step) {
+                    for (auto level = order; ; level = level.next_level()) {
+                        b.sides[level.side].update(level.get_priority(), level);
+                        if (level.levels == 0) break;
+                    }
+                    old->second = order;
+                    return;
+                }
+            }
+            if (old != b.rows.end()) {
+                for (auto level = old->second; ; level = level.next_level()) {
+                    b.sides[level.side].erase(level.get_priority());
+                    if (level.levels == 0) break;
+                }
+                b.rows.erase(old);
+            }
+            if (!change.present) return;
+
+            auto order = unpack<exchange_state>(change.data);
+            for (auto level = order; ; level = level.next_level()) {
+                b.sides[level.side].insert(level.get_priority(), level, level.price == order.price);
+                if (level.levels == 0) break;
+            }
+            b.rows[order.id] = order;
+        }
+
+        const book* books::find(symbol_type a, symbol_type b) const {
+            auto itr = _by_symbols.find(pair_t::symbols_key(a, b));
+            if (itr == _by_symbols.end()) {
+                itr = _by_symbols.find(pair_t::symbols_key(b, a));
+            }
+            return itr == _by_symbols.end() ? nullptr : &_books.at(itr->second);
+        }
+
+        std::vector<price_level> books::depth(const book& b, uint8_t side, size_t levels, uint32_t time) const {
+            const auto& s = b.sides[side];
+            std::vector<price_level> result;
+            for (size_t i = 0; i < s.size(); i++) {
+                if (s.expirations[i] && s.expirations[i] <= time) continue;
+                if (result.empty() || result.back().price != s.prices[i]) {
+                    if (result.size() == levels) break;
+                    result.push_back(price_level{s.prices[i], 0});
+                }
+                result.back().amount += s.amounts[i];
+            }
+            return result;
+        }
+
+        // the mirror's counterpart of the match walk in matching.cpp. Every
+        // ladder level already has an entry of its own, in matching order;
+        // the contract only reaches a deeper level through the one before
+        // it, so those of a ladder it steps over are never seen. The reserve
+        // takes its turns where the contract's walk gives them
+        template<typename Take, typename TakeReserve>
+        void walk(const book& b, account_name seller, const asset& goal, uint64_t limit_price,
+                  uint16_t max_fills, uint32_t time, quote_t& result, Take&& take, TakeReserve&& take_reserve) {
+            auto side = result.side;
+            const auto& s = b.sides[side];
+            reserve_t pool = b.reserve;
+            auto from_reserve = [&](uint64_t bound) {
+                if (pool.empty()) return false;
+                auto fill = take_reserve(pool, bound, result);
+                if (fill.out == 0) return false;
+                pool = pool.traded(side, fill.out, fill.in);
+                result.sold.amount += fill.in;
+                result.received.amount += fill.out;
+                result.fills.push_back(fill);
+                return (goal.symbol == result.sold.symbol ? result.sold : result.received) == goal;
+            };
+            for (size_t i = 0; i < s.size(); i++) {
+                bool skipped = s.managers[i] == seller || (s.expirations[i] && s.expirations[i] <= time);
+                if (skipped && !s.fronts[i]) continue;
+                if (limit_price && (side == ask ? s.prices[i] > limit_price : s.prices[i] < limit_price)) break;
+                if (max_fills && result.fills.size() == max_fills) {
+                    result.bounded = true;
+                    return;
+                }
+                if (s.managers[i] == seller) continue;
+                if (s.expirations[i] && s.expirations[i] <= time) {
+                    result.expired.push_back(s.ids[i]);
+                    continue;
+                }
+                if (from_reserve(s.prices[i])) return;
+                if (max_fills && result.fills.size() == max_fills) {
+                    result.bounded = true;
+                    return;
+                }
+
+                exchange_state level{s.ids[i], s.managers[i], side, s.amounts[i], s.prices[i], s.expirations[i], 0, 0, 0};
+                auto fill = take(level, result);
+                result.sold.amount += fill.in;
+                result.received.amount += fill.out;
+                result.fills.push_back(fill);
+
+                if ((goal.symbol == result.sold.symbol ? result.sold : result.received) == goal) return;
+            }
+            if (!max_fills || result.fills.size() < max_fills) {
+                from_reserve(limit_price);
+            }
+        }
+
+        quote_t books::quote_buy(const book& b, account_name seller, const asset& receive,
+                                 uint16_t max_fills, uint32_t time) const {
+            const auto& pair = b.pair;
+            uint8_t side = receive.symbol == pair.base_symbol ? ask : bid;
+            quote_t result{side, asset(0, side == ask ? pair.quote_symbol : pair.base_symbol), asset(0, receive.symbol), {}, {}, false};
+            if (receive.amount == 0) return result;
+
+            walk(b, seller, receive, 0, max_fills, time, result, [&](const exchange_state& order, const quote_t& so_far) {
+                return fill_receiving(pair, order, receive.amount - so_far.received.amount);
+            }, [&](const reserve_t& pool, uint64_t bound, const quote_t& so_far) {
+                return reserve_receiving(pair, pool, side, receive.amount - so_far.received.amount, bound);
+            });
+            return result;
+        }
+
+        quote_t books::quote_sell(const book& b, account_name seller, const asset& sell, uint64_t limit_price,
+                                  uint16_t max_fills, uint32_t time) const {
+            const auto& pair = b.pair;
+            uint8_t side = sell.symbol == pair.quote_symbol ? ask : bid;
+            quote_t result{side, asset(0, sell.symbol), asset(0, side == ask ? pair.base_symbol : pair.quote_symbol), {}, {}, false};
+            if (sell.amount == 0) return result;
+
+            walk(b, seller, sell, limit_price, max_fills, time, result, [&](const exchange_state& order, const quote_t& so_far) {
+                return fill_selling(pair, order, sell.amount - so_far.sold.amount);
+            }, [&](const reserve_t& pool, uint64_t bound, const quote_t& so_far) {
+                return reserve_selling(pair, pool, side, sell.amount - so_far.sold.amount, bound);
+            });
+            return result;
+        }
+
+        std::vector<row_change> snapshot_of(account_name contract,
+                                            const std::map<native::table_id, native::table_store>& db) {
+            std::vector<row_change> rows;
+            for (const auto& table : db) {
+                if (std::get<0>(table.first) != contract) continue;
+                for (const auto& row : table.second.rows) {
+                    rows.push_back(row_change{std::get<2>(table.first), std::get<1>(table.first),
+                                              row.first, true, row.second.data});
+                }
+            }
+            return rows;
+        }
+
+        void write_snapshot(const std::string& path, const std::vector<row_change>& rows) {
+            std::ofstream file(path, std::ios::binary);
+            auto bytes = pack(rows);
+            if (!file.write(bytes.data(), bytes.size())) {
+                throw std::runtime_error("can't write snapshot " + path);
+            }
+        }
+    } // namespace mirror
+} // namespace eosio
@@ -0,0 +1,111 @@
+#pragma once
+
+// Off-chain copy of the contract's books for API servers. It loads a
+// snapshot of the `pairs`, `markets` and `reserves` rows, keeps every book as
+// price-sorted arrays, applies row changes as the chain streams them and
+// answers depth and quote queries with the contract's own fill math.
+//
+// It decodes rows with the contract's serialization from exchange_state.hpp
+// on top of the native eosiolib, so a build compiles mirror.cpp together
+// with exchange_state.cpp and matching.cpp (or exchange.cpp, which
+// includes both).
+
+#include <eosiolib/eosio.hpp>
+#include <boost/container/flat_map.hpp>
+#include <map>
+#include <string>
+#include "../exchange_state.hpp"
+#include "../matching.hpp"
+
+namespace eosio {
+    namespace mirror {
+
+        // one row of the contract's tables as the chain reports it; a
+        // snapshot file is a packed vector of these, all present
+        struct row_change {
+            uint64_t table;
+            uint64_t scope;
+            uint64_t primary_key;
+            // false once the row is erased, when data is empty
+            bool present;
+            std::vector<char> data;
+
+            EOSLIB_SERIALIZE(row_change, (table)(scope)(primary_key)(present)(data))
+        };
+
+        // One side of a book in matching order, one entry per order and per
+        // ladder level. Queries stream through the arrays they need only.
+        struct side_book {
+            std::vector<uint128_t> keys;
+            std::vector<uint64_t> prices;
+            std::vector<int64_t> amounts;
+            std::vector<uint64_t> ids;
+            std::vector<account_name> managers;
+            std::vector<uint32_t> expirations;
+            // whether the entry is its row's best level, as opposed to a
+            // deeper ladder level
+            std::vector<uint8_t> fronts;
+
+            size_t size() const { return keys.size(); }
+
+            void insert(uint128_t key, const exchange_state& level, bool front);
+
+            void erase(uint128_t key);
+
+            // overwrites the entry at key, if any, without moving the others
+            bool update(uint128_t key, const exchange_state& level);
+        };
+
+        struct book {
+            pair_t pair;
+            side_book sides[2];
+            // the rows behind the entries, so a change can take out what
+            // the row held before
+            boost::container::flat_map<uint64_t, exchange_state> rows;
+            // the pair's reserve, empty while it has none
+            reserve_t reserve;
+        };
+
+        class books {
+        public:
+            explicit books(account_name contract) : _contract(contract) {}
+
+            // replaces every book with a snapshot file; throws
+            // std::runtime_error when it can't be read
+            void load(const std::string& path);
+
+            // a row of `pairs`, `markets` or `reserves` was written or
+            // erased; other tables are ignored
+            void apply(const row_change& change);
+
+            // the book trading the two tokens, in either order, or nullptr
+            const book* find(symbol_type a, symbol_type b) const;
+
+            // the best `levels` prices of a side with what they hold, skipping
+            // orders expired at time
+            std::vector<price_level> depth(const book& b, uint8_t side, size_t levels, uint32_t time) const;
+
+            // as quote_buy and quote_sell in matching.hpp, against the mirror
+            quote_t quote_buy(const book& b, account_name seller, const asset& receive,
+                              uint16_t max_fills, uint32_t time) const;
+
+            quote_t quote_sell(const book& b, account_name seller, const asset& sell, uint64_t limit_price,
+                               uint16_t max_fills, uint32_t time) const;
+
+        private:
+            account_name _contract;
+            std::map<uint64_t, book> _books;
+            boost::container::flat_map<uint128_t, uint64_t> _by_symbols;
+
+            void _apply_pair(const row_change& change);
+
+            void _apply_order(const row_change& change);
+        };
+
+        // every row of contract's tables as present row changes
+        std::vector<row_change> snapshot_of(account_name contract,
+                                            const std::map<native::table_id, native::table_store>& db);
+
+        void write_snapshot(const std::string& path, const std::vector<row_change>& rows);
+    } // namespace mirror
+} // namespace eosio
@@ -0,0 +1,297 @@
+// Replays a recorded stream of exchange actions through the native build of
+// the contract and reports what each action type cost: latency percentiles
+// and histogram, table operations and inline actions sent. The figures can
+// be saved and compared against another build's run of the same recording.
+//
+//   replay [--abi FILE] [--loyalty 4,LTA]... [--setup FILE] [--out FILE] [--pack FILE] RECORDING
+//   replay --compare BASE NEW
+//
+// A recording ending in .json or .jsonl holds action objects as nodeos
+// prints them, one per line or in an array:
+//
+//   {"name": "createx", "authorization": [{"actor": "alice", "permission": "active"}],
+//    "data": {"creator": "alice", ...}, "block_time": "2018-06-01T12:00:00.000"}
+//
+// with the data encoded through the ABI, or given packed as "hex_data".
+// Any other file is a packed vector<recorded_action>, which --pack writes
+// from any recording so later runs skip the JSON. Every run starts
+// from empty tables with the --loyalty tokens registered; the --setup
+// recording runs first, untimed, to build the books the recording expects.
+
+#include "harness.hpp"
+#include "abi.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+
+using namespace eosio;
+using namespace eosio::native;
+
+namespace {
+
+    const account_name self = N(exchange);
+
+    struct recorded_action {
+        // block time in seconds, 0 to leave the clock where it is
+        uint32_t time;
+        action_name name;
+        std::vector<account_name> auths;
+        std::vector<char> data;
+    };
+
+    // what one action type cost over a run; saved packed for --compare
+    struct action_stats {
+        action_name name;
+        uint64_t failed;
+        std::string first_error;
+        // latency of every successful action, sorted once the run is over
+        std::vector<uint64_t> ns;
+        uint64_t reads;
+        uint64_t writes;
+        uint64_t inline_actions;
+    };
+
+    bool ends_with(const std::string& s, const char* suffix) {
+        auto n = strlen(suffix);
+        return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+    }
+
+    // "2018-06-01T12:00:00.000", in UTC
+    uint32_t parse_time(const std::string& text) {
+        std::tm tm{};
+        if (sscanf(text.c_str(), "%d-%d-%dT%d:%d:%d", &tm.tm_year, &tm.tm_mon, &tm.tm_mday,
+                   &tm.tm_hour, &tm.tm_min, &tm.tm_sec) != 6) {
+            throw std::runtime_error("bad time " + text);
+        }
+        tm.tm_year -= 1900;
+        tm.tm_mon -= 1;
+        return (uint32_t) timegm(&tm);
+    }
+
+    recorded_action from_json(const abi& contract_abi, const json& a) {
+        recorded_action result{0, string_to_name(a.at("name").text.c_str()), {}, {}};
+        if (auto auths = a.find("authorization")) {
+            for (const auto& auth : auths->items) {
+                const auto& actor = auth.kind == json::object ? auth.at("actor") : auth;
+                result.auths.push_back(string_to_name(actor.text.c_str()));
+            }
+        }
+        if (auto hex = a.find("hex_data")) {
+            result.data = from_hex(hex->text);
+        } else {
+            result.data = contract_abi.encode_action(result.name, a.at("data"));
+        }
+        if (auto time = a.find("block_time")) {
+            result.time = parse_time(time->text);
+        } else if (auto seconds = a.find("time")) {
+            result.time = (uint32_t) std::stoul(seconds->text);
+        }
+        return result;
+    }
+
+    std::vector<recorded_action> load_recording(const std::string& path, const std::string& abi_path) {
+        auto text = read_file(path);
+        if (!ends_with(path, ".json") && !ends_with(path, ".jsonl")) {
+            return unpack<std::vector<recorded_action>>(text.data(), text.size());
+        }
+
+        // lines and array elements read alike once wrapped in one more array
+        auto all = json::parse("[" + text + "]");
+        const auto& actions = all.items.size() == 1 && all.items[0].kind == json::array ? all.items[0] : all;
+        auto contract_abi = abi::load(abi_path);
+        std::vector<recorded_action> result;
+        for (const auto& a : actions.items) {
+            result.push_back(from_json(contract_abi, a));
+        }
+        return result;
+    }
+
+    std::vector<action_stats> replay(const std::vector<recorded_action>& actions, bool timed) {
+        std::map<action_name, action_stats> by_name;
+        for (const auto& a : actions) {
+            if (a.time) ctx().time_us = (uint64_t) a.time * 1000000;
+            // replayed actions ran on chain, so a failure here is the replay
+            // drifting from the chain's state; it is counted and left out
+            auto result = push_packed(self, a.name, a.data, a.auths);
+            if (!timed) continue;
+
+            auto& stats = by_name[a.name];
+            stats.name = a.name;
+            if (!result.ok) {
+                if (stats.failed++ == 0) stats.first_error = result.error;
+                continue;
+            }
+            stats.ns.push_back(result.ns);
+            stats.reads += result.stats.db_reads;
+            stats.writes += result.stats.db_writes + result.stats.db_erases;
+            stats.inline_actions += result.stats.inline_actions;
+        }
+
+        std::vector<action_stats> result;
+        for (auto& s : by_name) {
+            std::sort(s.second.ns.begin(), s.second.ns.end());
+            result.push_back(std::move(s.second));
+        }
+        return result;
+    }
+
+    uint64_t percentile(const std::vector<uint64_t>& sorted, double p) {
+        if (sorted.empty()) return 0;
+        return sorted[std::min(sorted.size() - 1, (size_t) (p * sorted.size()))];
+    }
+
+    double mean(const std::vector<uint64_t>& values) {
+        double sum = 0;
+        for (auto v : values) sum += v;
+        return values.empty() ? 0 : sum / values.size();
+    }
+
+    double per_action(uint64_t total, const action_stats& s) {
+        return s.ns.empty() ? 0 : (double) total / s.ns.size();
+    }
+
+    // power-of-two buckets from the fastest action to the slowest
+    void histogram(const action_stats& s) {
+        if (s.ns.empty()) return;
+        std::map<int, uint64_t> buckets;
+        uint64_t largest = 0;
+        for (auto ns : s.ns) {
+            int bucket = 63 - __builtin_clzll(ns | 1);
+            largest = std::max(largest, ++buckets[bucket]);
+        }
+
+        printf("%s latency (ns)\n", name{s.name}.to_string().c_str());
+        for (int b = buckets.begin()->first; b <= buckets.rbegin()->first; b++) {
+            uint64_t count = buckets.count(b) ? buckets[b] : 0;
+            int width = (int) (count * 40 / largest);
+            printf("  %10llu - %10llu |%-40s %llu\n", 1ull << b, (2ull << b) - 1,
+                   std::string(width, '#').c_str(), (unsigned long long) count);
+        }
+    }
+
+    void report(const std::vector<action_stats>& stats) {
+        printf("%-14s %8s %7s %10s %10s %10s %10s %10s %8s %8s %8s\n", "action", "count", "failed",
+               "mean ns", "p50 ns", "p90 ns", "p99 ns", "max ns", "reads", "writes", "inline");
+        for (const auto& s : stats) {
+            printf("%-14s %8zu %7llu %10.0f %10llu %10llu %10llu %10llu %8.1f %8.1f %8.1f\n",
+                   name{s.name}.to_string().c_str(), s.ns.size(), (unsigned long long) s.failed, mean(s.ns),
+                   (unsigned long long) percentile(s.ns, 0.5), (unsigned long long) percentile(s.ns, 0.9),
+                   (unsigned long long) percentile(s.ns, 0.99), (unsigned long long) (s.ns.empty() ? 0 : s.ns.back()),
+                   per_action(s.reads, s), per_action(s.writes, s), per_action(s.inline_actions, s));
+        }
+        for (const auto& s : stats) {
+            if (s.failed) {
+                printf("%-14s first failure: %s\n", name{s.name}.to_string().c_str(), s.first_error.c_str());
+            }
+        }
+        printf("\n");
+        for (const auto& s : stats) histogram(s);
+    }
+
+    std::string change(double base, double now) {
+        char text[32];
+        if (base == 0) {
+            snprintf(text, sizeof(text), "%s", now == 0 ? "" : "new");
+        } else {
+            snprintf(text, sizeof(text), "%+.1f%%", (now - base) * 100 / base);
+        }
+        return text;
+    }
+
+    // the same recording through two builds, per action type
+    void compare(const std::vector<action_stats>& base, const std::vector<action_stats>& now) {
+        std::map<action_name, std::pair<const action_stats*, const action_stats*>> both;
+        for (const auto& s : base) both[s.name].first = &s;
+        for (const auto& s : now) both[s.name].second = &s;
+
+        printf("%-14s %-8s %8s %10s %10s %10s %8s %8s %8s\n", "action", "build", "count",
+               "p50 ns", "p99 ns", "mean ns", "reads", "writes", "inline");
+        static const action_stats none{};
+        for (const auto& entry : both) {
+            const auto& a = entry.second.first ? *entry.second.first : none;
+            const auto& b = entry.second.second ? *entry.second.second : none;
+            auto label = name{entry.first}.to_string();
+            for (int i = 0; i < 2; i++) {
+                const auto& s = i == 0 ? a : b;
+                printf("%-14s %-8s %8zu %10llu %10llu %10.0f %8.1f %8.1f %8.1f\n", i == 0 ? label.c_str() : "",
+                       i == 0 ? "base" : "new", s.ns.size(),
+                       (unsigned long long) percentile(s.ns, 0.5), (unsigned long long) percentile(s.ns, 0.99),
+                       mean(s.ns), per_action(s.reads, s), per_action(s.writes, s), per_action(s.inline_actions, s));
+            }
+            printf("%-14s %-8s %8s %10s %10s %10s %8s %8s %8s\n", "", "change", "",
+                   change(percentile(a.ns, 0.5), percentile(b.ns, 0.5)).c_str(),
+                   change(percentile(a.ns, 0.99), percentile(b.ns, 0.99)).c_str(),
+                   change(mean(a.ns), mean(b.ns)).c_str(),
+                   change(per_action(a.reads, a), per_action(b.reads, b)).c_str(),
+                   change(per_action(a.writes, a), per_action(b.writes, b)).c_str(),
+                   change(per_action(a.inline_actions, a), per_action(b.inline_actions, b)).c_str());
+        }
+    }
+
+    template<typename T>
+    void save(const std::string& path, const T& value) {
+        std::ofstream file(path, std::ios::binary);
+        auto bytes = pack(value);
+        if (!file.write(bytes.data(), bytes.size())) throw std::runtime_error("can't write " + path);
+    }
+
+    std::vector<action_stats> load_stats(const std::string& path) {
+        auto bytes = read_file(path);
+        return unpack<std::vector<action_stats>>(bytes.data(), bytes.size());
+    }
+
+    int usage() {
+        fprintf(stderr, "usage: replay [--abi FILE] [--loyalty 4,LTA]... [--setup FILE] [--out FILE] [--pack FILE] RECORDING\n"
+                        "       replay --compare BASE NEW\n");
+        return 2;
+    }
+
+} // namespace
+
+int main(int argc, char** argv) {
+    std::string abi_path = "build/exchange.abi";
+    std::string setup_path;
+    std::string out_path;
+    std::string pack_path;
+    std::string recording_path;
+    std::vector<std::string> loyalty;
+
+    try {
+        for (int i = 1; i < argc; i++) {
+            std::string arg = argv[i];
+            if (arg == "--compare" && i + 2 < argc) {
+                compare(load_stats(argv[i + 1]), load_stats(argv[i + 2]));
+                return 0;
+            }
+            if (i + 1 < argc && arg == "--abi") abi_path = argv[++i];
+            else if (i + 1 < argc && arg == "--setup") setup_path = argv[++i];
+            else if (i + 1 < argc && arg == "--out") out_path = argv[++i];
+            else if (i + 1 < argc && arg == "--pack") pack_path = argv[++i];
+            else if (i + 1 < argc && arg == "--loyalty") loyalty.push_back(argv[++i]);
+            else if (arg.compare(0, 2, "--") != 0 && recording_path.empty()) recording_path = arg;
+            else return usage();
+        }
+        if (recording_path.empty()) return usage();
+
+        reset();
+        for (const auto& symbol : loyalty) {
+            auto comma = symbol.find(',');
+            if (comma == std::string::npos) return usage();
+            add_loyalty_token(LOYALTY_CONTRACT, symbol_type(string_to_symbol(
+                    (uint8_t) std::stoul(symbol.substr(0, comma)), symbol.substr(comma + 1).c_str())));
+        }
+        if (!setup_path.empty()) replay(load_recording(setup_path, abi_path), false);
+
+        auto recording = load_recording(recording_path, abi_path);
+        if (!pack_path.empty()) save(pack_path, recording);
+
+        auto stats = replay(recording, true);
+        report(stats);
+        if (!out_path.empty()) save(out_path, stats);
+    } catch (std::exception& e) {
+        fprintf(stderr, "replay: %s\n", e.what());
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,535 @@
+// Behavior tests against the native build of the contract.
+//
+// Each test starts from an empty chain, drives actions through `apply` and
+// checks the tables and balances they leave behind. Most accounts trade out
+// of the deposit ledger, so what every fill and refund moved is visible in
+// their `balances` rows; the others settle through the token contracts and
+// are checked on the allowclaim, claim and transfer actions sent for them.
+
+#include "harness.hpp"
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <string>
+
+using namespace eosio;
+using namespace eosio::native;
+
+namespace {
+
+    const account_name self = N(exchange);
+    const symbol_type WU = wu_token::symbol;
+    const symbol_type LTA = S(4, LTA);
+    const symbol_type LTB = S(4, LTB);
+    const account_name alice = N(alice);
+    const account_name bob = N(bob);
+    const account_name carol = N(carol);
+
+    int failures = 0;
+
+#define CHECK(condition) check(condition, #condition, __LINE__)
+
+    void check(bool condition, const char* what, int line) {
+        if (condition) return;
+        printf("  line %d: %s\n", line, what);
+        failures++;
+    }
+
+    void expect_ok(const outcome& result, int line) {
+        if (result.ok) return;
+        printf("  line %d: failed with \"%s\"\n", line, result.error.c_str());
+        failures++;
+    }
+
+    void expect_error(const outcome& result, const char* error, int line) {
+        if (!result.ok && result.error == error) return;
+        printf("  line %d: expected \"%s\", got %s\n", line, error, result.ok ? "success" : result.error.c_str());
+        failures++;
+    }
+
+#define EXPECT_OK(result) expect_ok(result, __LINE__)
+#define EXPECT_ERROR(result, error) expect_error(result, error, __LINE__)
+
+    uint32_t now_seconds() {
+        return (uint32_t) (ctx().time_us / 1000000);
+    }
+
+    // LTA/WU and LTB/WU with alice, bob and carol whitelisted. Deposited
+    // accounts hold 1000 of LTA and WU each in the deposit ledger; the
+    // others settle through the token contracts
+    void setup(bool deposited = true) {
+        reset();
+        add_loyalty_token(LOYALTY_CONTRACT, LTA);
+        add_loyalty_token(LOYALTY_CONTRACT, LTB);
+        push(self, N(whitemany), std::vector<account_name>{alice, bob, carol}, {self});
+        add_pair(self, LTA, WU);
+        add_pair(self, LTB, WU);
+        if (!deposited) return;
+        for (auto owner : {alice, bob, carol}) {
+            push(self, N(deposit), exchange::deposit{owner, asset(10000000, LTA)}, {owner});
+            push(self, N(deposit), exchange::deposit{owner, asset(10000000, WU)}, {owner});
+        }
+    }
+
+    balance_t balance(account_name owner, symbol_type symbol) {
+        balance_t result{extended_asset(0, extended_symbol(symbol, 0)), 0};
+        as_contract(self, [&]() {
+            balances_table balances(self, owner);
+            auto row = balances.find(symbol.name());
+            if (row != balances.end()) result = *row;
+        });
+        return result;
+    }
+
+    int64_t available(account_name owner, symbol_type symbol) {
+        return balance(owner, symbol).balance.amount;
+    }
+
+    int64_t reserved(account_name owner, symbol_type symbol) {
+        return balance(owner, symbol).reserved;
+    }
+
+    size_t rows(uint64_t scope, uint64_t table) {
+        auto store = find_table(self, scope, table);
+        return store ? store->rows.size() : 0;
+    }
+
+    // the order's row, or all zeroes once it is gone
+    exchange_state order(uint64_t pair_id, uint64_t id) {
+        exchange_state result{};
+        as_contract(self, [&]() {
+            markets_table markets(self, pair_id);
+            auto row = markets.find(id);
+            if (row != markets.end()) result = *row;
+        });
+        return result;
+    }
+
+    struct token_action {
+        account_name from;
+        asset quantity;
+
+        EOSLIB_SERIALIZE(token_action, (from)(quantity))
+    };
+
+    struct token_transfer {
+        account_name from;
+        account_name to;
+        asset quantity;
+        std::string memo;
+
+        EOSLIB_SERIALIZE(token_transfer, (from)(to)(quantity)(memo))
+    };
+
+    std::string symbol_string(symbol_type symbol) {
+        std::string result;
+        for (auto name = symbol.name(); name; name >>= 8) result += (char) (name & 0xFF);
+        return result;
+    }
+
+    // the token actions the last action sent for owner, in order, as
+    // "claim 200000 WU"
+    std::vector<std::string> settled(account_name owner) {
+        std::vector<std::string> result;
+        for (const auto& sent : ctx().actions) {
+            account_name account;
+            asset quantity;
+            if (sent.name == N(allowclaim) || sent.name == N(claim)) {
+                auto data = unpack<token_action>(sent.data);
+                account = data.from;
+                quantity = data.quantity;
+            } else if (sent.name == N(transfer)) {
+                auto data = unpack<token_transfer>(sent.data);
+                account = data.to;
+                quantity = data.quantity;
+            } else {
+                continue;
+            }
+            if (account != owner) continue;
+            result.push_back(name{sent.name}.to_string() + " " + std::to_string(quantity.amount) + " " + symbol_string(quantity.symbol));
+        }
+        return result;
+    }
+
+    // bob asks 10 LTA at 2 WU each
+    void rest_ask(uint32_t expiration = 0) {
+        EXPECT_OK(push(self, N(createx), exchange::createx{bob, asset(100000, LTA), asset(200000, WU), expiration}, {bob}));
+    }
+
+    void test_fills() {
+        setup();
+        rest_ask();
+        CHECK(reserved(bob, LTA) == 100000);
+        CHECK(available(bob, LTA) == 9900000);
+
+        EXPECT_OK(push(self, N(market.trade), exchange::market_trade{alice, WU, asset(40000, LTA), 0, 0}, {alice}));
+        CHECK(order(0, 0).amount == 60000);
+        CHECK(available(alice, LTA) == 10040000);
+        CHECK(available(alice, WU) == 9920000);
+        CHECK(available(bob, WU) == 10080000);
+        CHECK(reserved(bob, LTA) == 60000);
+
+        // the rest of the order, and nothing else is left to take
+        EXPECT_OK(push(self, N(market.trade), exchange::market_trade{alice, WU, asset(60000, LTA), 0, 0}, {alice}));
+        CHECK(rows(0, N(markets)) == 0);
+        CHECK(reserved(bob, LTA) == 0);
+        CHECK(available(bob, WU) == 10200000);
+        EXPECT_ERROR(push(self, N(market.trade), exchange::market_trade{alice, WU, asset(1, LTA), 0, 0}, {alice}),
+                     "unable to fill");
+    }
+
+    void test_refunds() {
+        setup();
+        rest_ask();
+        EXPECT_ERROR(push(self, N(cancelx), exchange::cancelx{0, LTA, WU}, {alice}), "missing authority of bob");
+        EXPECT_OK(push(self, N(cancelx), exchange::cancelx{0, LTA, WU}, {bob}));
+        CHECK(rows(0, N(markets)) == 0);
+        CHECK(reserved(bob, LTA) == 0);
+        CHECK(available(bob, LTA) == 10000000);
+
+        // a ladder escrows every level and gives all of them back
+        EXPECT_OK(push(self, N(createladder), exchange::createladder{bob, asset(10000, LTA), WU, 300000000, 10000000, 4, 0}, {bob}));
+        CHECK(reserved(bob, LTA) == 40000);
+        EXPECT_OK(push(self, N(cancelall), exchange::cancelall{bob, LTA, WU}, {bob}));
+        CHECK(reserved(bob, LTA) == 0);
+        CHECK(available(bob, LTA) == 10000000);
+    }
+
+    void test_expiry() {
+        setup();
+        rest_ask(now_seconds() + 10);
+        CHECK(rows(0, N(expiring)) == 1);
+
+        ctx().time_us += 20 * 1000000ull;
+        EXPECT_ERROR(push(self, N(spec.trade), exchange::spec_trade{0, alice, WU, asset(100000, LTA)}, {alice}),
+                     "order expired");
+        EXPECT_ERROR(push(self, N(market.trade), exchange::market_trade{alice, WU, asset(10000, LTA), 0, 0}, {alice}),
+                     "unable to fill");
+
+        // anyone may purge, and the maker gets the escrow back without signing
+        EXPECT_OK(push(self, N(purge), exchange::purge{LTA, WU, 10}, {carol}));
+        CHECK(rows(0, N(markets)) == 0);
+        CHECK(rows(0, N(expiring)) == 0);
+        CHECK(reserved(bob, LTA) == 0);
+        CHECK(available(bob, LTA) == 10000000);
+
+        // orders expiring together whose ids differ by 2^32 both get listed
+        uint32_t expiration = now_seconds() + 10;
+        rest_ask(expiration);
+        as_contract(self, [&]() {
+            markets_table markets(self, 0);
+            markets.emplace(self, [&](auto& s) { s.id = (1ull << 32) - 1; });
+        });
+        EXPECT_OK(push(self, N(createx), exchange::createx{bob, asset(100000, LTA), asset(300000, WU), expiration}, {bob}));
+        CHECK(order(0, 1ull << 32).expiration == expiration);
+        as_contract(self, [&]() {
+            markets_table markets(self, 0);
+            markets.erase(markets.get((1ull << 32) - 1));
+        });
+        CHECK(rows(0, N(expiring)) == 2);
+
+        ctx().time_us += 20 * 1000000ull;
+        EXPECT_OK(push(self, N(purge), exchange::purge{LTA, WU, 10}, {carol}));
+        CHECK(rows(0, N(markets)) == 0);
+        CHECK(rows(0, N(expiring)) == 0);
+        CHECK(reserved(bob, LTA) == 0);
+        CHECK(available(bob, LTA) == 10000000);
+    }
+
+    void test_time_in_force() {
+        setup();
+        rest_ask();
+
+        // fill-or-kill leaves nothing behind when the book can't cover it
+        EXPECT_ERROR(push(self, N(market.trade), exchange::market_trade{alice, WU, asset(150000, LTA), exchange::fill_or_kill, 0}, {alice}),
+                     "unable to fill");
+        CHECK(order(0, 0).amount == 100000);
+        EXPECT_ERROR(push(self, N(limit.trade), exchange::limit_trade{alice, asset(300000, WU), LTA, 0, exchange::fill_or_kill, 0}, {alice}),
+                     "unable to fill");
+
+        // immediate-or-cancel takes what there is and keeps the rest
+        EXPECT_OK(push(self, N(limit.trade), exchange::limit_trade{alice, asset(100000, WU), LTA, 0, exchange::immediate_or_cancel, 0}, {alice}));
+        CHECK(order(0, 0).amount == 50000);
+        EXPECT_OK(push(self, N(market.trade), exchange::market_trade{alice, WU, asset(150000, LTA), exchange::immediate_or_cancel, 0}, {alice}));
+        CHECK(rows(0, N(markets)) == 0);
+        CHECK(available(alice, LTA) == 10100000);
+        CHECK(available(alice, WU) == 9800000);
+
+        // good-till-cancel rests the remainder at its limit as a bid
+        rest_ask();
+        EXPECT_ERROR(push(self, N(limit.trade), exchange::limit_trade{alice, asset(300000, WU), LTA, 0, exchange::good_till_cancel, 0}, {alice}),
+                     "good-till-cancel orders need a limit price");
+        EXPECT_OK(push(self, N(limit.trade), exchange::limit_trade{alice, asset(300000, WU), LTA, 200000000, exchange::good_till_cancel, 0}, {alice}));
+        CHECK(rows(0, N(markets)) == 1);
+        // the ask it took left the book empty, so the bid reuses its id
+        auto bid_order = order(0, 0);
+        CHECK(bid_order.side == bid);
+        CHECK(bid_order.manager == alice);
+        CHECK(bid_order.amount == 100000);
+        CHECK(bid_order.price == 200000000);
+        CHECK(reserved(alice, WU) == 100000);
+    }
+
+    void test_auction() {
+        pair_t pair{0, LTA, WU};
+
+        // 10 LTA asked from 1 WU, 30 WU bid up to 3: both 1 and 3 trade all
+        // 10 LTA, and 3 leaves no demand unmatched
+        vector<auction_order> bids{{0, alice, false, bid, 300000, 300000000}};
+        vector<auction_order> asks{{0, bob, false, ask, 100000, 100000000}};
+        auto result = run_auction(pair, bids, asks);
+        CHECK(result.price == 300000000);
+        CHECK(result.fills.size() == 1 && result.fills[0].base == 100000 && result.fills[0].quote == 300000);
+
+        // one owner never trades with itself, nor two resting orders
+        bids = {{0, bob, false, bid, 300000, 300000000}};
+        asks = {{0, bob, false, ask, 100000, 100000000}};
+        CHECK(run_auction(pair, bids, asks).fills.empty());
+        bids = {{0, alice, true, bid, 300000, 300000000}};
+        asks = {{0, bob, true, ask, 100000, 100000000}};
+        CHECK(run_auction(pair, bids, asks).fills.empty());
+
+        // bob's own bid makes 3 the price where the most crosses, but only
+        // alice's bid can take his ask, and only at 1
+        bids = {{0, bob, false, bid, 300000, 300000000}, {1, alice, false, bid, 100000, 100000000}};
+        asks = {{0, bob, false, ask, 100000, 100000000}};
+        result = run_auction(pair, bids, asks);
+        CHECK(result.price == 100000000);
+        CHECK(result.fills.size() == 1 && result.fills[0].base == 100000 && result.fills[0].quote == 100000);
+        CHECK(result.fills.size() == 1 && bids[result.fills[0].bid].owner == alice);
+
+        // through `clear`: both queued orders settle out of their escrow
+        setup();
+        EXPECT_OK(push(self, N(limit.trade), exchange::limit_trade{bob, asset(100000, LTA), WU, 100000000, exchange::batch, 0}, {bob}));
+        EXPECT_OK(push(self, N(limit.trade), exchange::limit_trade{alice, asset(300000, WU), LTA, 300000000, exchange::batch, 0}, {alice}));
+        CHECK(rows(0, N(pending)) == 2);
+        EXPECT_OK(push(self, N(clear), exchange::clear{LTA, WU, 10}, {carol}));
+        CHECK(rows(0, N(pending)) == 0);
+        CHECK(available(bob, WU) == 10300000);
+        CHECK(available(alice, LTA) == 10100000);
+        CHECK(reserved(alice, WU) == 0);
+        CHECK(reserved(bob, LTA) == 0);
+    }
+
+    uint128_t reserve_k() {
+        uint128_t k = 0;
+        as_contract(self, [&]() {
+            reserves_table reserves(self, self);
+            auto& reserve = reserves.get(0);
+            k = (uint128_t) reserve.base * reserve.quote;
+        });
+        return k;
+    }
+
+    void test_reserve() {
+        setup();
+        EXPECT_OK(push(self, N(addliquidity), exchange::addliquidity{carol, asset(1000000, LTA), asset(2000000, WU)}, {carol}));
+        auto k = reserve_k();
+
+        // an ask inside the reserve's spread fills before the reserve does
+        EXPECT_OK(push(self, N(createx), exchange::createx{bob, asset(10000, LTA), asset(20000, WU), 0}, {bob}));
+        CHECK(rows(0, N(markets)) == 1);
+        EXPECT_OK(push(self, N(market.trade), exchange::market_trade{alice, WU, asset(10000, LTA), 0, 0}, {alice}));
+        CHECK(rows(0, N(markets)) == 0);
+        CHECK(reserve_k() == k);
+
+        // trades both ways only ever grow base * quote, by the fee
+        for (int i = 0; i < 10; i++) {
+            auto buyer = i % 2 ? alice : bob;
+            EXPECT_OK(push(self, N(market.trade), exchange::market_trade{buyer, WU, asset(10000 + i * 1000, LTA), 0, 0}, {buyer}));
+            CHECK(reserve_k() > k);
+            k = reserve_k();
+            EXPECT_OK(push(self, N(limit.trade), exchange::limit_trade{buyer, asset(7000 + i * 1000, LTA), WU, 0, 1, 0}, {buyer}));
+            CHECK(reserve_k() > k);
+            k = reserve_k();
+        }
+
+    }
+
+    void test_external() {
+        setup(false);
+
+        // the order's escrow is allowed, not moved
+        rest_ask();
+        CHECK((settled(bob) == std::vector<std::string>{"allowclaim 100000 LTA"}));
+
+        // a partial fill claims what it pays out of the escrow
+        EXPECT_OK(push(self, N(market.trade), exchange::market_trade{alice, WU, asset(40000, LTA), 0, 0}, {alice}));
+        CHECK(order(0, 0).amount == 60000);
+        CHECK((settled(bob) == std::vector<std::string>{"claim 40000 LTA", "transfer 80000 WU"}));
+        CHECK((settled(alice) == std::vector<std::string>{"allowclaim 80000 WU", "claim 80000 WU", "transfer 40000 LTA"}));
+
+        // and a full fill claims the rest of it
+        EXPECT_OK(push(self, N(market.trade), exchange::market_trade{alice, WU, asset(60000, LTA), 0, 0}, {alice}));
+        CHECK(rows(0, N(markets)) == 0);
+        CHECK((settled(bob) == std::vector<std::string>{"claim 60000 LTA", "transfer 120000 WU"}));
+
+        // a maker cancelling revokes its allowance
+        rest_ask();
+        EXPECT_OK(push(self, N(cancelx), exchange::cancelx{0, LTA, WU}, {bob}));
+        CHECK((settled(bob) == std::vector<std::string>{"allowclaim -100000 LTA"}));
+
+        // anyone else releasing it claims the escrow and pays it back
+        rest_ask(now_seconds() + 10);
+        ctx().time_us += 20 * 1000000ull;
+        EXPECT_OK(push(self, N(purge), exchange::purge{LTA, WU, 10}, {carol}));
+        CHECK(rows(0, N(markets)) == 0);
+        CHECK((settled(bob) == std::vector<std::string>{"claim 100000 LTA", "transfer 100000 LTA"}));
+        CHECK(settled(carol).empty());
+    }
+
+    void test_routed_maker() {
+        setup(false);
+
+        // bob bids 20 WU for 10 LTA and asks 10 LTB for 20 WU, and alice's
+        // routed trade fills both: the WU bob's bid pays out comes back to
+        // him through his ask, yet each leg settles on its own
+        EXPECT_OK(push(self, N(createx), exchange::createx{bob, asset(200000, WU), asset(100000, LTA), 0}, {bob}));
+        EXPECT_OK(push(self, N(createx), exchange::createx{bob, asset(100000, LTB), asset(200000, WU), 0}, {bob}));
+        EXPECT_OK(push(self, N(trade), exchange::trade{alice, asset(100000, LTA), asset(100000, LTB)}, {alice}));
+        CHECK(rows(0, N(markets)) == 0);
+        CHECK(rows(1, N(markets)) == 0);
+        CHECK((settled(bob) == std::vector<std::string>{
+                "claim 100000 LTB", "claim 200000 WU", "transfer 100000 LTA", "transfer 200000 WU"}));
+        CHECK((settled(alice) == std::vector<std::string>{
+                "allowclaim 100000 LTA", "claim 100000 LTA", "transfer 100000 LTB"}));
+    }
+
+    checksum256 hash(const char* data, size_t size) {
+        checksum256 result;
+        sha256(data, size, &result);
+        return result;
+    }
+
+    checksum256 leaf(account_name account) {
+        char data[1 + sizeof(account)] = {0};
+        memcpy(data + 1, &account, sizeof(account));
+        return hash(data, sizeof(data));
+    }
+
+    checksum256 node(checksum256 a, checksum256 b) {
+        if (memcmp(a.hash, b.hash, sizeof(a.hash)) > 0) std::swap(a, b);
+        char data[1 + 2 * sizeof(a.hash)] = {1};
+        memcpy(data + 1, a.hash, sizeof(a.hash));
+        memcpy(data + 1 + sizeof(a.hash), b.hash, sizeof(b.hash));
+        return hash(data, sizeof(data));
+    }
+
+    void test_merkle() {
+        setup();
+        account_name dave = N(dave), erin = N(erin), frank = N(frank), mallory = N(mallory);
+        auto dave_erin = node(leaf(dave), leaf(erin));
+        auto root = node(dave_erin, leaf(frank));
+        EXPECT_OK(push(self, N(whiteroot), root, {self}));
+
+        EXPECT_ERROR(push(self, N(createx), exchange::createx{dave, asset(1000, LTA), asset(1000, WU), 0}, {dave}),
+                     "Account is not whitelisted");
+        EXPECT_OK(push(self, N(whiteproof), std::make_tuple(dave, std::vector<checksum256>{leaf(erin), leaf(frank)}), {dave}));
+        EXPECT_OK(push(self, N(createx), exchange::createx{dave, asset(1000, LTA), asset(1000, WU), 0}, {dave}));
+        EXPECT_OK(push(self, N(whiteproof), std::make_tuple(frank, std::vector<checksum256>{dave_erin}), {frank}));
+        EXPECT_ERROR(push(self, N(whiteproof), std::make_tuple(mallory, std::vector<checksum256>{dave_erin}), {mallory}),
+                     "Invalid whitelist proof");
+        EXPECT_ERROR(push(self, N(whiteproof), std::make_tuple(erin, std::vector<checksum256>{leaf(dave)}), {erin}),
+                     "Invalid whitelist proof");
+
+        // a new root drops every proof of the old one
+        EXPECT_OK(push(self, N(whiteroot), dave_erin, {self}));
+        EXPECT_ERROR(push(self, N(createx), exchange::createx{frank, asset(1000, LTA), asset(1000, WU), 0}, {frank}),
+                     "Account is not whitelisted");
+    }
+
+    void test_cleanstate() {
+        setup();
+        account_name dave = N(dave), erin = N(erin);
+        EXPECT_OK(push(self, N(whiteroot), node(leaf(dave), leaf(erin)), {self}));
+        EXPECT_OK(push(self, N(whiteproof), std::make_tuple(dave, std::vector<checksum256>{leaf(erin)}), {dave}));
+        rest_ask();
+
+        // a few rows per call, until the cursor is gone with the last of them
+        int calls = 0;
+        do {
+            EXPECT_OK(push(self, N(cleanstate), std::make_tuple(uint64_t(2), false), {self}));
+        } while (rows(self, N(cleanup)) && ++calls < 20);
+        CHECK(calls > 1);
+        CHECK(rows(self, N(cleanup)) == 0);
+        CHECK(rows(self, N(pairs)) == 0);
+        CHECK(rows(self, N(whitelist)) == 0);
+        CHECK(rows(self, N(verified)) == 0);
+        CHECK(rows(self, N(whiteroot)) == 0);
+        CHECK(reserved(bob, LTA) == 0);
+        CHECK(available(bob, LTA) == 10000000);
+    }
+
+    void test_migrate() {
+        // a version 5 book: one-sided rows, one of them with an expiration,
+        // and a WU-based pair whose bids move into the LTA/WU book
+        auto seed = []() {
+            reset();
+            add_loyalty_token(LOYALTY_CONTRACT, LTA);
+            add_pair(self, LTA, WU);
+            add_pair(self, WU, LTA);
+            as_contract(self, [&]() {
+                one_sided_markets_table asks(self, 0), bids(self, 1);
+                asks.emplace(bob, [&](auto& s) { s = one_sided_exchange_state{0, bob, 100000, 200000000, 0}; });
+                asks.emplace(bob, [&](auto& s) { s = one_sided_exchange_state{1, bob, 100000, 300000000, now_seconds() + 10}; });
+                bids.emplace(alice, [&](auto& s) { s = one_sided_exchange_state{0, alice, 200000, 50000000, 0}; });
+                schema_singleton(self, self).set(schema_t{5}, self);
+            });
+        };
+
+        seed();
+        int calls = 0;
+        while (push(self, N(migrate), uint64_t(1), {self}).ok) calls++;
+        CHECK(calls > 3);
+        auto paginated = ctx().db;
+
+        seed();
+        EXPECT_OK(push(self, N(migrate), uint64_t(100), {self}));
+        EXPECT_ERROR(push(self, N(migrate), uint64_t(100), {self}), "Tables are already up to date");
+        CHECK(rows(0, N(markets)) == 3);
+        CHECK(rows(0, N(expiring)) == 1);
+        CHECK(rows(self, N(pairs)) == 1);
+        CHECK(rows(self, N(migration)) == 0);
+        CHECK(order(0, 2).side == bid);
+        CHECK(order(0, 2).price == 200000000);
+        CHECK(order(0, 1).expiration == now_seconds() + 10);
+
+        for (auto& table : ctx().db) {
+            auto other = paginated.find(table.first);
+            CHECK(other != paginated.end() && other->second.rows.size() == table.second.rows.size());
+        }
+    }
+
+    struct test_case {
+        const char* name;
+        std::function<void()> run;
+    };
+
+} // namespace
+
+int main() {
+    const test_case tests[] = {
+            {"fills",         test_fills},
+            {"refunds",       test_refunds},
+            {"expiry",        test_expiry},
+            {"time_in_force", test_time_in_force},
+            {"auction",       test_auction},
+            {"reserve",       test_reserve},
+            {"external",      test_external},
+            {"routed_maker",  test_routed_maker},
+            {"merkle",        test_merkle},
+            {"cleanstate",    test_cleanstate},
+            {"migrate",       test_migrate},
+    };
+
+    int failed = 0;
+    for (const auto& test : tests) {
+        int before = failures;
+        test.run();
+        bool ok = failures == before;
+        printf("%-14s %s\n", test.name, ok ? "ok" : "FAILED");
+        failed += !ok;
+    }
+    printf("%d of %zu tests failed\n", failed, sizeof(tests) / sizeof(tests[0]));
+    return failed ? 1 : 0;
+}
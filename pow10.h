@@ -1,3 +1,5 @@
+#pragma once
+
 #define POW10_0  1LL
 #define POW10_1  10LL
 #define POW10_2  100LL
@@ -15,5 +17,12 @@
 #define POW10_14 100000000000000LL
 #define POW10_15 1000000000000000LL
 #define POW10_16 10000000000000000LL
+#define POW10_17 100000000000000000LL
+#define POW10_18 1000000000000000000LL
 #define POW10_EXPAND(N) POW10_ ## N
 #define POW10(N) POW10_EXPAND(N)
+
+static constexpr uint64_t POW10_TABLE[] = {
+        POW10_0, POW10_1, POW10_2, POW10_3, POW10_4, POW10_5, POW10_6, POW10_7, POW10_8, POW10_9,
+        POW10_10, POW10_11, POW10_12, POW10_13, POW10_14, POW10_15, POW10_16, POW10_17, POW10_18
+};
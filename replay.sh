@@ -0,0 +1,121 @@
+#!/usr/bin/env bash
+set -e
+
+BUILD_DIR=native/build
+NATIVE_DIR=native
+CPP_FILENAME=exchange.cpp
+REPLAY_FILENAME=replay
+CXX=${CXX:-g++}
+
+ARGUMENT_LIST=(
+	"RECORDING"
+	"SETUP"
+	"LOYALTY"
+	"ABI"
+	"BASELINE"
+)
+
+opts=$(getopt \
+	--longoptions "$(printf "%s:," "${ARGUMENT_LIST[@]}")TRACE" \
+	--name "$(basename "$0")" \
+	--options "" \
+	-- "$@"
+)
+
+function usage() {
+	echo "Usage: ./replay.sh [ARGS]"
+	echo "--RECORDING - recorded actions, .json/.jsonl as nodeos prints them or packed (required)"
+	echo "--SETUP - recording replayed untimed first to build the books (optional)"
+	echo "--LOYALTY - loyalty token symbols to register, space separated (default \"4,LTA 4,LTB\")"
+	echo "--ABI - ABI the JSON action data is encoded with (default build/exchange.abi)"
+	echo "--BASELINE - git revision to replay as well and compare against"
+	echo "--TRACE - build with EXCHANGE_TRACE"
+	echo "Example:"
+	echo "./replay.sh --RECORDING yesterday.jsonl --SETUP books.jsonl --BASELINE HEAD"
+}
+
+# $1 tree with the contract and native harness, $2 binary name
+function compile() {
+	mkdir -p ${BUILD_DIR}
+	${CXX} -std=c++17 -O2 ${DEFINES} -I$1/${NATIVE_DIR} -o ${BUILD_DIR}/$2 $1/${NATIVE_DIR}/replay.cpp $1/${CPP_FILENAME}
+}
+
+# $1 binary name, $2 stats file
+function run() {
+	local args=(--abi "${ABI}" --out "$2")
+	for symbol in ${LOYALTY}; do
+		args+=(--loyalty "${symbol}")
+	done
+	if [[ -n "${SETUP}" ]]; then
+		args+=(--setup "${SETUP}")
+	fi
+	${BUILD_DIR}/$1 "${args[@]}" "${RECORDING}"
+}
+
+RECORDING=
+SETUP=
+LOYALTY="4,LTA 4,LTB"
+ABI=build/exchange.abi
+BASELINE=
+DEFINES=
+
+eval set --$opts
+while [[ $# -gt 0 ]]; do
+	case "$1" in
+		--RECORDING)
+			RECORDING=$2
+			shift 2
+			;;
+
+		--SETUP)
+			SETUP=$2
+			shift 2
+			;;
+
+		--LOYALTY)
+			LOYALTY=$2
+			shift 2
+			;;
+
+		--ABI)
+			ABI=$2
+			shift 2
+			;;
+
+		--BASELINE)
+			BASELINE=$2
+			shift 2
+			;;
+
+		--TRACE)
+			DEFINES=-DEXCHANGE_TRACE
+			shift
+			;;
+		*)
+			break
+			;;
+	esac
+done
+
+if [[ -z "${RECORDING}" ]]; then
+	usage
+	exit 1
+fi
+
+compile . ${REPLAY_FILENAME}
+run ${REPLAY_FILENAME} ${BUILD_DIR}/replay.stats
+
+if [[ -n "${BASELINE}" ]]; then
+	# the baseline builds from its own tree, so it needs native/replay.cpp too
+	WORKTREE=$(mktemp -d)
+	git worktree add --detach --quiet "${WORKTREE}" "${BASELINE}"
+	trap 'git worktree remove --force "${WORKTREE}"' EXIT
+	compile "${WORKTREE}" ${REPLAY_FILENAME}-baseline
+
+	echo
+	echo "baseline ${BASELINE}"
+	run ${REPLAY_FILENAME}-baseline ${BUILD_DIR}/replay-baseline.stats
+
+	echo
+	${BUILD_DIR}/${REPLAY_FILENAME} --compare ${BUILD_DIR}/replay-baseline.stats ${BUILD_DIR}/replay.stats
+fi
@@ -0,0 +1,162 @@
+#include "settlement.hpp"
+
+namespace eosio {
+
+    settlement::entry_t& settlement::entry(account_name owner, const extended_asset& quantity) {
+        return _entries[key_t{owner, quantity.contract, quantity.symbol}];
+    }
+
+    void settlement::allow(account_name owner, extended_asset quantity) {
+        entry(owner, quantity).allowance += quantity.amount;
+    }
+
+    void settlement::release(account_name owner, extended_asset quantity) {
+        entry(owner, quantity).released += quantity.amount;
+    }
+
+    void settlement::debit(account_name owner, extended_asset quantity) {
+        entry(owner, quantity).debited += quantity.amount;
+    }
+
+    void settlement::charge(account_name owner, extended_asset quantity) {
+        entry(owner, quantity).charged += quantity.amount;
+    }
+
+    void settlement::credit(account_name owner, extended_asset quantity) {
+        entry(owner, quantity).credited += quantity.amount;
+    }
+
+    void settlement::fill(account_name taker, account_name maker, extended_asset paid, extended_asset received) {
+        charge(taker, paid);
+        credit(maker, paid);
+        debit(maker, received);
+        credit(taker, received);
+    }
+
+    void settlement::cross(account_name seller, account_name buyer, extended_asset base, extended_asset quote) {
+        debit(seller, base);
+        credit(buyer, base);
+        debit(buyer, quote);
+        credit(seller, quote);
+    }
+
+    void settlement::deposit(account_name owner, extended_asset quantity) {
+        entry(owner, quantity).deposited += quantity.amount;
+    }
+
+    void settlement::withdraw(account_name owner, extended_asset quantity) {
+        entry(owner, quantity).withdrawn += quantity.amount;
+    }
+
+    void settlement::flush() {
+        for (auto& item : _entries) {
+            balances_table balances(_self, item.first.owner);
+            auto row = balances.find(symbol_type(item.first.symbol).name());
+            item.second.internal = row != balances.end() && row->balance.contract == item.first.contract;
+        }
+
+        // every allowclaim goes out before the claims, and every claim before
+        // the transfers, so the exchange holds the funds it pays out
+        for (const auto& item : _entries) {
+            const auto& e = item.second;
+            int64_t allowance;
+            if (e.internal) {
+                allowance = e.deposited > e.withdrawn ? e.deposited - e.withdrawn : 0;
+            } else {
+                // a taker only allows what it still owes after netting what it receives
+                int64_t owed = e.charged - e.credited;
+                allowance = e.allowance + (owed > 0 ? owed : 0);
+            }
+            if (allowance != 0) {
+                send_allowclaim(item.first.owner, extended_asset(allowance, item.first.get_symbol()));
+            }
+        }
+        // only a claim uses up an allowance, so what an order pays out of its
+        // escrow and a released escrow are claimed in full rather than
+        // netted; only a taker's charge nets against what it receives
+        for (const auto& item : _entries) {
+            const auto& e = item.second;
+            int64_t net = e.internal ? e.withdrawn - e.deposited : e.credited - e.charged;
+            int64_t claimed = (net < 0 ? -net : 0) + (e.internal ? 0 : e.debited + e.released);
+            if (claimed > 0) {
+                send_claim(item.first.owner, extended_asset(claimed, item.first.get_symbol()));
+            }
+        }
+        for (const auto& item : _entries) {
+            const auto& e = item.second;
+            int64_t net = e.internal ? e.withdrawn - e.deposited : e.credited - e.charged;
+            int64_t paid = (net > 0 ? net : 0) + (e.internal ? 0 : e.released);
+            if (paid > 0) {
+                send_transfer(item.first.owner, extended_asset(paid, item.first.get_symbol()));
+            }
+        }
+        for (const auto& item : _entries) {
+            if (item.second.internal) {
+                settle_internal(item.first, item.second);
+            }
+        }
+        _entries.clear();
+    }
+
+    void settlement::settle_internal(const key_t& key, const entry_t& e) {
+        balances_table balances(_self, key.owner);
+        auto row = balances.find(symbol_type(key.symbol).name());
+        balances.modify(row, 0, [&](auto& b) {
+            b.balance.amount += e.credited - e.charged + e.deposited - e.withdrawn - e.allowance + e.released;
+            b.reserved += e.allowance - e.debited - e.released;
+        });
+        eosio_assert(row->balance.amount >= 0, "overdrawn balance");
+        eosio_assert(row->reserved >= 0, "overdrawn reserve");
+        TRACE_COUNT(rows_written, 1);
+
+        // an emptied row switches the account back to settling through the token contract
+        if (row->balance.amount == 0 && row->reserved == 0) {
+            balances.erase(row);
+            TRACE_COUNT(rows_erased, 1);
+        }
+    }
+
+    void settlement::send_allowclaim(account_name owner, extended_asset quantity) {
+        struct allowclaim {
+            account_name from;
+            asset quantity;
+        };
+
+        action(eosio::vector<permission_level>{
+                   permission_level(owner, N(active)),
+                   permission_level(_self, N(active))
+               },
+               quantity.contract,
+               N(allowclaim),
+               allowclaim{owner, quantity}).send();
+        TRACE_COUNT(inline_actions, 1);
+    }
+
+    void settlement::send_claim(account_name owner, extended_asset quantity) {
+        struct claim {
+            account_name from;
+            asset quantity;
+        };
+
+        action(permission_level(_self, N(active)),
+               quantity.contract,
+               N(claim),
+               claim{owner, quantity}).send();
+        TRACE_COUNT(inline_actions, 1);
+    }
+
+    void settlement::send_transfer(account_name to, extended_asset quantity) {
+        struct transfer {
+            account_name from;
+            account_name to;
+            asset quantity;
+            std::string memo;
+        };
+
+        action(permission_level(_self, N(active)),
+               quantity.contract,
+               N(transfer),
+               transfer{_self, to, quantity, "claim"}).send();
+        TRACE_COUNT(inline_actions, 1);
+    }
+} // namespace eosio
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <eosiolib/eosio.hpp>
+#include <eosiolib/asset.hpp>
+#include <boost/container/flat_map.hpp>
+#include "exchange_state.hpp"
+
+namespace eosio {
+
+    // Collects the token movements of one action and sends them netted:
+    // at most one allowclaim, claim and transfer per (account, token). Only
+    // a taker's charge nets against what it receives; what comes out of an
+    // earlier allowance is always claimed, so the allowance is used up.
+    // Accounts holding a `balances` row for the token are settled on that
+    // row instead, without any inline action.
+    class settlement {
+    public:
+        settlement(account_name self) : _self(self) {}
+
+        // owner lets the exchange claim quantity in a later action (negative revokes)
+        void allow(account_name owner, extended_asset quantity);
+
+        // the exchange hands back quantity owner allowed in an earlier action,
+        // without owner's authority: claimed and transferred straight back
+        void release(account_name owner, extended_asset quantity);
+
+        // owner pays quantity it allowed in an earlier action (a resting order)
+        void debit(account_name owner, extended_asset quantity);
+
+        // owner pays quantity it allows in this action (a taker)
+        void charge(account_name owner, extended_asset quantity);
+
+        // the exchange pays quantity to owner
+        void credit(account_name owner, extended_asset quantity);
+
+        // taker pays maker `paid` and receives `received` from the maker's order
+        void fill(account_name taker, account_name maker, extended_asset paid, extended_asset received);
+
+        // two escrowed orders trade: seller pays base and buyer pays quote,
+        // each out of what it allowed earlier
+        void cross(account_name seller, account_name buyer, extended_asset base, extended_asset quote);
+
+        // quantity moves from the token contract into owner's balances row
+        void deposit(account_name owner, extended_asset quantity);
+
+        // quantity moves from owner's balances row back to the token contract
+        void withdraw(account_name owner, extended_asset quantity);
+
+        void flush();
+
+    private:
+        struct key_t {
+            account_name owner;
+            account_name contract;
+            symbol_name symbol;
+
+            extended_symbol get_symbol() const { return extended_symbol(symbol, contract); }
+
+            friend bool operator<(const key_t& a, const key_t& b) {
+                return std::tie(a.owner, a.contract, a.symbol) < std::tie(b.owner, b.contract, b.symbol);
+            }
+        };
+
+        struct entry_t {
+            int64_t allowance;
+            int64_t charged;
+            int64_t debited;
+            int64_t credited;
+            int64_t deposited;
+            int64_t withdrawn;
+            int64_t released;
+            bool internal;
+        };
+
+        entry_t& entry(account_name owner, const extended_asset& quantity);
+
+        void settle_internal(const key_t& key, const entry_t& e);
+
+        void send_allowclaim(account_name owner, extended_asset quantity);
+
+        void send_claim(account_name owner, extended_asset quantity);
+
+        void send_transfer(account_name to, extended_asset quantity);
+
+        account_name _self;
+        boost::container::flat_map<key_t, entry_t> _entries;
+    };
+} // namespace eosio
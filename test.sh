@@ -0,0 +1,45 @@
+#!/usr/bin/env bash
+set -e
+
+BUILD_DIR=native/build
+NATIVE_DIR=native
+CPP_FILENAME=exchange.cpp
+TEST_FILENAME=test
+CXX=${CXX:-g++}
+
+opts=$(getopt \
+	--longoptions "TRACE" \
+	--name "$(basename "$0")" \
+	--options "" \
+	-- "$@"
+)
+
+function usage() {
+	echo "Usage: ./test.sh [ARGS]"
+	echo "--TRACE - build with EXCHANGE_TRACE"
+	echo "Example:"
+	echo "./test.sh"
+}
+
+function compile() {
+	mkdir -p ${BUILD_DIR}
+	${CXX} -std=c++17 -O2 -Wall -Wextra ${DEFINES} -I${NATIVE_DIR} -o ${BUILD_DIR}/${TEST_FILENAME} ${NATIVE_DIR}/test.cpp ${CPP_FILENAME}
+}
+
+DEFINES=
+
+eval set --$opts
+while [[ $# -gt 0 ]]; do
+	case "$1" in
+		--TRACE)
+			DEFINES=-DEXCHANGE_TRACE
+			shift
+			;;
+		*)
+			break
+			;;
+	esac
+done
+
+compile
+${BUILD_DIR}/${TEST_FILENAME}
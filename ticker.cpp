@@ -0,0 +1,130 @@
+#include "ticker.hpp"
+
+#include <algorithm>
+
+namespace eosio {
+
+    void tickers::rest(uint64_t pair_id, uint8_t side, uint64_t price, int64_t amount) {
+        _pending[pair_id].levels[side][price] += amount;
+    }
+
+    void tickers::fill(uint64_t pair_id, uint8_t side, uint64_t price, int64_t base, int64_t quote) {
+        rest(pair_id, side, price, side == ask ? -base : -quote);
+        trade(pair_id, price, base, quote);
+    }
+
+    void tickers::trade(uint64_t pair_id, uint64_t price, int64_t base, int64_t quote) {
+        auto& pending = _pending[pair_id];
+        pending.last_price = price;
+        pending.base_volume += base;
+        pending.quote_volume += quote;
+    }
+
+    void tickers::flush() {
+        tickers_table rows(_self, _self);
+        for (const auto& item : _pending) {
+            const auto& pending = item.second;
+            auto update = [&](ticker_t& t) {
+                if (pending.last_price) {
+                    t.last_price = pending.last_price;
+                }
+                t.base_volume += pending.base_volume;
+                t.quote_volume += pending.quote_volume;
+                t.best_ask = t.asks.empty() ? 0 : t.asks.front().price;
+                t.best_bid = t.bids.empty() ? 0 : t.bids.front().price;
+            };
+
+            auto row = rows.find(item.first);
+            TRACE_COUNT(rows_written, 1);
+            if (row == rows.end()) {
+                // the book already holds this action's changes, so a new row
+                // is built from it directly
+                rows.emplace(_self, [&](auto& t) {
+                    t.pair_id = item.first;
+                    t.last_price = 0;
+                    t.base_volume = 0;
+                    t.quote_volume = 0;
+                    refill(t.pair_id, t.asks, ask);
+                    refill(t.pair_id, t.bids, bid);
+                    update(t);
+                });
+            } else {
+                rows.modify(row, 0, [&](auto& t) {
+                    if (apply_levels(t.asks, ask, pending.levels[ask])) {
+                        refill(t.pair_id, t.asks, ask);
+                    }
+                    if (apply_levels(t.bids, bid, pending.levels[bid])) {
+                        refill(t.pair_id, t.bids, bid);
+                    }
+                    update(t);
+                });
+            }
+        }
+        _pending.clear();
+    }
+
+    // returns whether levels beyond the tracked ones have to be read from the book
+    bool tickers::apply_levels(vector<price_level>& levels, uint8_t side,
+                               const boost::container::flat_map<uint64_t, int64_t>& changes) const {
+        // with fewer than TICKER_DEPTH levels the row holds the whole side
+        bool whole_book = levels.size() < TICKER_DEPTH;
+
+        // levels run best first: ascending for asks, descending for bids
+        auto better = [side](uint64_t a, uint64_t b) { return side == ask ? a < b : a > b; };
+        for (const auto& change : changes) {
+            if (change.second == 0) continue;
+            auto itr = std::lower_bound(levels.begin(), levels.end(), change.first,
+                                        [&](const price_level& l, uint64_t price) { return better(l.price, price); });
+            if (itr != levels.end() && itr->price == change.first) {
+                itr->amount += change.second;
+                eosio_assert(itr->amount >= 0, "ticker out of sync with the book");
+                if (itr->amount == 0) {
+                    levels.erase(itr);
+                }
+            } else if (change.second > 0 && (itr != levels.end() || whole_book)) {
+                levels.insert(itr, price_level{change.first, change.second});
+            }
+        }
+
+        if (levels.size() > TICKER_DEPTH) {
+            levels.resize(TICKER_DEPTH);
+        }
+        return !whole_book && levels.size() < TICKER_DEPTH;
+    }
+
+    void tickers::refill(uint64_t pair_id, vector<price_level>& levels, uint8_t side) const {
+        markets_table markets(_self, pair_id);
+        auto by_price = markets.get_index<N(byprice)>();
+        auto better = [side](uint64_t a, uint64_t b) { return side == ask ? a < b : a > b; };
+
+        // adds the levels past the worst tracked one. A ladder ahead of it
+        // may have levels there too, so the side is read from its best order
+        bool tracked = !levels.empty();
+        uint64_t worst = tracked ? levels.back().price : 0;
+        size_t wanted = TICKER_DEPTH - levels.size();
+        vector<price_level> found;
+        // false once price is past every level that can still be kept
+        auto add = [&](uint64_t price, int64_t amount) {
+            if (tracked && !better(worst, price)) return true;
+            if (found.size() == wanted && better(found.back().price, price)) return false;
+            auto itr = std::lower_bound(found.begin(), found.end(), price,
+                                        [&](const price_level& l, uint64_t p) { return better(l.price, p); });
+            if (itr != found.end() && itr->price == price) {
+                itr->amount += amount;
+            } else {
+                found.insert(itr, price_level{price, amount});
+                if (found.size() > wanted) {
+                    found.pop_back();
+                }
+            }
+            return true;
+        };
+        for (auto order = by_price.lower_bound(exchange_state::priority_key(side, side == ask ? 0 : UINT64_MAX, 0));
+             order != by_price.end() && order->side == side; order++) {
+            if (found.size() == wanted && better(found.back().price, order->price)) break;
+            TRACE_COUNT(rows_visited, 1);
+            for (auto level = *order; add(level.price, level.amount) && level.levels > 0; level = level.next_level()) {}
+        }
+        levels.insert(levels.end(), found.begin(), found.end());
+    }
+} // namespace eosio
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <eosiolib/eosio.hpp>
+#include <boost/container/flat_map.hpp>
+#include "exchange_state.hpp"
+
+namespace eosio {
+
+    // Collects how one action changes each book and applies it to the
+    // pair's `tickers` row once, after dispatch. Only the best TICKER_DEPTH
+    // levels of each side are tracked; the book is read again only when a
+    // tracked level empties and the side has to be topped back up.
+    class tickers {
+    public:
+        tickers(account_name self) : _self(self) {}
+
+        // what side holds at price grew (positive) or shrank (negative) outside a fill
+        void rest(uint64_t pair_id, uint8_t side, uint64_t price, int64_t amount);
+
+        // a resting order on side at price traded base for quote
+        void fill(uint64_t pair_id, uint8_t side, uint64_t price, int64_t base, int64_t quote);
+
+        // base traded for quote at price, whichever orders took part
+        void trade(uint64_t pair_id, uint64_t price, int64_t base, int64_t quote);
+
+        void flush();
+
+    private:
+        struct pending_t {
+            // changes per side, indexed by order_side
+            boost::container::flat_map<uint64_t, int64_t> levels[2];
+            uint64_t last_price;
+            int64_t base_volume;
+            int64_t quote_volume;
+        };
+
+        bool apply_levels(vector<price_level>& levels, uint8_t side,
+                          const boost::container::flat_map<uint64_t, int64_t>& changes) const;
+
+        void refill(uint64_t pair_id, vector<price_level>& levels, uint8_t side) const;
+
+        account_name _self;
+        boost::container::flat_map<uint64_t, pending_t> _pending;
+    };
+} // namespace eosio
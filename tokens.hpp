@@ -0,0 +1,52 @@
+#pragma once
+
+#include <eosiolib/types.hpp>
+#include <eosiolib/symbol.hpp>
+#include "str_expand.h"
+#include "config.h"
+
+namespace eosio {
+
+    // a token pairs are priced in: the contract issuing it and its symbol
+    template<account_name Contract, symbol_name Symbol>
+    struct quote_token {
+        static constexpr account_name contract = Contract;
+        static constexpr symbol_name symbol = Symbol;
+    };
+
+    // WU and the loyalty token contract as compile.sh writes them to config.h
+    typedef quote_token<string_to_name(STR(WU_ACCOUNT)), string_to_symbol(WU_DECIMALS, STR(WU_SYMBOL))> wu_token;
+
+    static constexpr account_name LOYALTY_CONTRACT = string_to_name(STR(LT_ACCOUNT));
+
+    // Which contract issues a token, resolved at compile time. Every pair
+    // trades a loyalty token against one of Quotes; any other symbol is a
+    // loyalty token issued by LOYALTY_CONTRACT.
+    template<typename... Quotes>
+    struct token_policy;
+
+    template<>
+    struct token_policy<> {
+        static constexpr bool is_quote(symbol_name) { return false; }
+
+        static constexpr account_name contract_of(symbol_name) { return LOYALTY_CONTRACT; }
+    };
+
+    template<typename Quote, typename... Rest>
+    struct token_policy<Quote, Rest...> {
+        static constexpr bool is_quote(symbol_name symbol) {
+            return symbol == Quote::symbol || token_policy<Rest...>::is_quote(symbol);
+        }
+
+        static constexpr account_name contract_of(symbol_name symbol) {
+            return symbol == Quote::symbol ? Quote::contract : token_policy<Rest...>::contract_of(symbol);
+        }
+    };
+
+    // the quote tokens of this build. Pairs, books and balances store only
+    // symbols, so a further quote token is one more entry here
+    typedef token_policy<wu_token> tokens;
+
+    static_assert(tokens::is_quote(wu_token::symbol), "WU must be a quote token");
+    static_assert(tokens::contract_of(wu_token::symbol) == wu_token::contract, "WU resolves to its own contract");
+} // namespace eosio
@@ -0,0 +1,45 @@
+#pragma once
+
+// Tracing for debug and profiling builds, enabled with -DEXCHANGE_TRACE.
+// Without it every macro here expands to nothing, so a release build
+// carries neither print calls nor counters. With it TRACE prints its
+// arguments and TRACE_COUNT adds to the counters of the running action,
+// which the native harness reads back after every push.
+
+#ifdef EXCHANGE_TRACE
+
+#include <eosiolib/print.hpp>
+
+namespace eosio {
+    namespace trace {
+
+        struct counters {
+            // book rows the match walks, refills and sweeps read
+            uint64_t rows_visited = 0;
+            // rows emplaced or modified, and rows erased, in any table
+            uint64_t rows_written = 0;
+            uint64_t rows_erased = 0;
+            // allowclaim, claim and transfer actions sent by settlement
+            uint64_t inline_actions = 0;
+            // orders a taker passed because the taker placed them
+            uint64_t own_skipped = 0;
+        };
+
+        inline counters& current() {
+            static counters c;
+            return c;
+        }
+    } // namespace trace
+} // namespace eosio
+
+#define TRACE(...) ::eosio::print(__VA_ARGS__)
+#define TRACE_COUNT(counter, n) (::eosio::trace::current().counter += (n))
+#define TRACE_RESET() (::eosio::trace::current() = ::eosio::trace::counters())
+
+#else
+
+#define TRACE(...) ((void) 0)
+#define TRACE_COUNT(counter, n) ((void) 0)
+#define TRACE_RESET() ((void) 0)
+
+#endif
@@ -29,14 +29,71 @@ namespace eosio {
     void whitelisted::whitemany(vector<account_name> accounts) {
         require_auth(_self);
         for (auto account : accounts) {
-            setwhite(account);
+            if (whitelist.find(account) == whitelist.end()) {
+                setwhite(account);
+            }
         }
     }
 
     void whitelisted::unwhitemany(vector<account_name> accounts) {
         require_auth(_self);
         for (auto account : accounts) {
-            unsetwhite(account);
+            if (whitelist.find(account) != whitelist.end()) {
+                unsetwhite(account);
+            }
         }
     }
+
+    void whitelisted::whiteroot(checksum256 root) {
+        require_auth(_self);
+        whiteroot_singleton current(_self, _self);
+        auto state = current.get_or_default(whiteroot_t{checksum256(), 0});
+        state.root = root;
+        state.version++;
+        current.set(state, _self);
+    }
+
+    void whitelisted::whiteproof(account_name account, vector<checksum256> proof) {
+        require_auth(account);
+        whiteroot_singleton current(_self, _self);
+        eosio_assert(current.exists(), "No whitelist root");
+        auto state = current.get();
+
+        char leaf[1 + sizeof(account)] = {0};
+        memcpy(leaf + 1, &account, sizeof(account));
+        checksum256 node;
+        sha256(leaf, sizeof(leaf), &node);
+        for (const auto& sibling : proof) {
+            char pair[1 + 2 * sizeof(node.hash)] = {1};
+            bool node_first = memcmp(node.hash, sibling.hash, sizeof(node.hash)) < 0;
+            memcpy(pair + 1, node_first ? node.hash : sibling.hash, sizeof(node.hash));
+            memcpy(pair + 1 + sizeof(node.hash), node_first ? sibling.hash : node.hash, sizeof(node.hash));
+            sha256(pair, sizeof(pair), &node);
+        }
+        eosio_assert(memcmp(node.hash, state.root.hash, sizeof(node.hash)) == 0, "Invalid whitelist proof");
+
+        verified_table verified(_self, _self);
+        auto row = verified.find(account);
+        if (row == verified.end()) {
+            verified.emplace(account, [&](auto& v) {
+                v.account = account;
+                v.version = state.version;
+                v.expiration = now() + VERIFIED_TTL;
+            });
+        } else {
+            verified.modify(row, account, [&](auto& v) {
+                v.version = state.version;
+                v.expiration = now() + VERIFIED_TTL;
+            });
+        }
+    }
+
+    bool whitelisted::is_verified(account_name account) {
+        verified_table verified(_self, _self);
+        auto row = verified.find(account);
+        if (row == verified.end() || row->expiration <= now()) return false;
+
+        whiteroot_singleton current(_self, _self);
+        return current.exists() && current.get().version == row->version;
+    }
 }
\ No newline at end of file
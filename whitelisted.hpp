@@ -1,9 +1,20 @@
 #pragma once
 
 #include <eosiolib/eosio.hpp>
+#include <eosiolib/crypto.h>
+#include <eosiolib/singleton.hpp>
 
 namespace eosio {
 
+    // An account is whitelisted by its own `whitelist` row, or by proving it
+    // is a leaf of the Merkle tree whose root the contract keeps. Large
+    // audiences need only the root on chain: each account proves itself
+    // once with `whiteproof`, which caches it in a `verified` row the
+    // account pays for, until the cache entry expires or the root changes.
+    //
+    // Leaves are sha256(0x00 || account as 8 little-endian bytes); an inner
+    // node is sha256(0x01 || lower child || higher child), the two children
+    // ordered bytewise, so a proof is just the sibling hashes leaf to root.
     class whitelisted : public contract {
     public:
         whitelisted(account_name self)
@@ -18,18 +29,54 @@ namespace eosio {
 
         multi_index<N(whitelist), whitelist> whitelist;
 
+        // version counts the roots set so far, so cache entries of an
+        // earlier root stop counting
+        struct whiteroot_t {
+            checksum256 root;
+            uint64_t version;
+
+            EOSLIB_SERIALIZE(whiteroot_t, (root)(version))
+        };
+
+        typedef singleton<N(whiteroot), whiteroot_t> whiteroot_singleton;
+
+        struct verified_t {
+            account_name account;
+            uint64_t version;
+            uint32_t expiration;
+
+            uint64_t primary_key() const { return account; }
+
+            EOSLIB_SERIALIZE(verified_t, (account)(version)(expiration))
+        };
+
+        typedef multi_index<N(verified), verified_t> verified_table;
+
+        // how long a proven account stays whitelisted, in seconds
+        static const uint32_t VERIFIED_TTL = 30 * 24 * 3600;
+
         void white(account_name account);
 
         void unwhite(account_name account);
 
+        // accounts already (or no longer) whitelisted are skipped
         void whitemany(vector<account_name> accounts);
 
         void unwhitemany(vector<account_name> accounts);
+
+        void whiteroot(checksum256 root);
+
+        void whiteproof(account_name account, vector<checksum256> proof);
     protected:
         void setwhite(account_name account);
 
         void unsetwhite(account_name account);
 
-        bool is_whitelisted(account_name account) { return whitelist.find(account) != whitelist.end(); }
+        bool is_whitelisted(account_name account) {
+            return whitelist.find(account) != whitelist.end() || is_verified(account);
+        }
+
+    private:
+        bool is_verified(account_name account);
     };
 } // namespace eosio